@@ -8,7 +8,31 @@
 #include <fstream>
 #include <regex>
 #include <sstream>
-#include "hdf5/serial/hdf5.h"
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <unordered_map>
+#include <map>
+#include <random>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <dlfcn.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
 //#include <vbz-compression/vbz.h>
 //#include <vbz-compression/vbz_plugin.h>
 
@@ -18,11 +42,34 @@
 namespace fs = std::filesystem;
 using namespace H5;
 
+// 随机读取单条 read 的延迟统计
+struct LatencyStats {
+    double p50_ms = 0.0;
+    double p99_ms = 0.0;
+    double reads_per_s = 0.0;
+};
+
+// 单个 spec 运行期间的内存占用
+struct MemoryStats {
+    double rss_peak_delta_mb = 0.0;     // 进程峰值 RSS 相对运行前 RSS 的增量
+    double rss_peak_mb = 0.0;           // 重置后进程峰值 RSS 的绝对值（VmHWM），含之前 spec 留下的缓冲池和堆
+    uint64_t tool_alloc_bytes = 0;      // 本程序（operator new）累计分配的字节数
+    uint64_t tool_peak_live_bytes = 0;  // 本程序同时存活分配的峰值
+    uint64_t h5_free_list_bytes = 0;    // 本次运行中 HDF5 内部 free list 占用的增量（H5get_free_list_sizes）
+    uint64_t mdc_bytes = 0;             // 输出文件关闭前的元数据缓存大小（H5Fget_mdc_size）
+    uint64_t chunk_cache_bytes = 0;     // 输出文件每个数据集的 chunk cache 上限（H5Pget_cache）
+};
+
 struct Result {
     std::string filter_name;
     uint64_t file_mb;
     double ratio; // compressed / baseline
-    double compress_ms;
+    double compress_ms;   // 主线程写入数据集的耗时，流水线路径包含等待编码完成的时间
+    double wall_ms = 0.0; // run_one 端到端耗时
+    double encode_cpu_ms = 0.0; // 工作线程编码各 chunk 的耗时之和，只有外部编码器路径非 0
+    LatencyStats cold;    // 随机读取延迟：每次读取前重新打开文件并丢弃页缓存
+    LatencyStats warm;    // 随机读取延迟：文件保持打开，数据已在缓存中
+    MemoryStats mem;
 };
 
 // 判断是都要解压的数据集
@@ -33,6 +80,18 @@ bool is_target_dataset(const std::string &fullpath, const std::string &dset_name
     return std::regex_search(fullpath, re);
 }
 
+// 路径中第一个 read_<id> 分量的 <id>，没有时返回空串
+std::string read_id_of(const std::string &path) {
+    size_t pos = 0;
+    while (pos < path.size()) {
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos) end = path.size();
+        if (end - pos > 5 && path.compare(pos, 5, "read_") == 0) return path.substr(pos + 5, end - pos - 5);
+        pos = end + 1;
+    }
+    return std::string();
+}
+
 // 复制属性从src_loc/name到dst_loc
 void copy_attributes(hid_t src_loc, const std::string &name, hid_t dst_loc) {
     hid_t obj = H5Oopen(src_loc, name.c_str(), H5P_DEFAULT);
@@ -76,9 +135,422 @@ void copy_attributes(hid_t src_loc, const std::string &name, hid_t dst_loc) {
     H5Oclose(obj);
 }
 
+// 合并布局下的对象路径
+const char *const CONSOLIDATED_GROUP = "/Consolidated";
+const char *const CONSOLIDATED_SIGNAL = "/Consolidated/Signal";
+const char *const CONSOLIDATED_INDEX = "/Consolidated/Index";
+
+// 热路径中被捕获的异常次数，用于评估异常驱动逻辑的开销
+size_t g_exceptions_caught = 0;
+
+// 本程序的堆分配统计：替换全局 operator new/delete，在每块内存前记录其大小
+// HDF5 C 库内部使用 malloc，不计入这里，由 H5get_free_list_sizes 等接口单独报告。
+// 每次分配都要做原子操作，会影响编码线程的计时，因此只在 TRACK_ALLOCATIONS 构建中启用，否则计数恒为 0
+std::atomic<uint64_t> g_alloc_bytes{0};
+std::atomic<uint64_t> g_alloc_live{0};
+std::atomic<uint64_t> g_alloc_peak{0};
+
+#ifdef TRACK_ALLOCATIONS
+const bool g_alloc_tracking = true;
+
+// 保持不内联：内联后编译器会把带偏移的指针与 malloc/free 配对检查，产生误报
+
+__attribute__((noinline)) void *operator new(size_t size) {
+    const size_t header = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+    void *raw = std::malloc(size + header);
+    if (!raw) throw std::bad_alloc();
+    *static_cast<size_t*>(raw) = size;
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    uint64_t live = g_alloc_live.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peak = g_alloc_peak.load(std::memory_order_relaxed);
+    while (live > peak && !g_alloc_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    return static_cast<char*>(raw) + header;
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept {
+    if (!ptr) return;
+    const size_t header = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+    void *raw = static_cast<char*>(ptr) - header;
+    g_alloc_live.fetch_sub(*static_cast<size_t*>(raw), std::memory_order_relaxed);
+    std::free(raw);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+#else
+const bool g_alloc_tracking = false;
+#endif
+
+// 从 /proc/self/status 读取指定字段（kB）
+uint64_t read_proc_status_kb(const std::string &field) {
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, field.size() + 1, field + ":") == 0) {
+            return std::stoull(line.substr(field.size() + 1));
+        }
+    }
+    return 0;
+}
+
+// 重置进程的峰值 RSS（VmHWM），内核不支持时返回 false
+bool reset_peak_rss() {
+    std::ofstream out("/proc/self/clear_refs");
+    out << "5";
+    out.flush();
+    return static_cast<bool>(out);
+}
+
+// 按 2 的幂分级的缓冲区池：跨数据集、跨 spec 复用读缓冲区，避免每个数据集重新分配
+class BufferPool {
+public:
+    std::vector<char> acquire(size_t bytes) {
+        size_t cls = size_class(bytes);
+        auto &fl = free_lists[cls];
+        std::vector<char> buf;
+        if (!fl.empty()) {
+            buf = std::move(fl.back());
+            fl.pop_back();
+            ++reuses;
+        } else {
+            buf.reserve(size_t(1) << cls);
+            ++allocations;
+        }
+        buf.resize(bytes);
+        return buf;
+    }
+    void release(std::vector<char> &&buf) {
+        if (buf.capacity() == 0) return;
+        // 按容量向下取整归类，保证同一级中的缓冲区都能容纳该级请求
+        size_t cls = 0;
+        while (cls + 1 < free_lists.size() && (size_t(1) << (cls + 1)) <= buf.capacity()) ++cls;
+        free_lists[cls].push_back(std::move(buf));
+    }
+    size_t allocations = 0;
+    size_t reuses = 0;
+private:
+    static size_t size_class(size_t bytes) {
+        size_t cls = 0;
+        while ((size_t(1) << cls) < bytes) ++cls;
+        return cls;
+    }
+    std::array<std::vector<std::vector<char>>, 64> free_lists;
+};
+
+// 源数据类型 -> 本机内存类型的缓存，避免对每个数据集调用 H5Tget_native_type
+// 返回的类型由缓存持有，调用者不能关闭
+class NativeTypeCache {
+public:
+    ~NativeTypeCache() {
+        for (auto &e : entries) {
+            H5Tclose(e.first);
+            H5Tclose(e.second);
+        }
+    }
+    hid_t get(hid_t src_type) {
+        for (auto &e : entries) {
+            if (H5Tequal(e.first, src_type) > 0) { ++hits; return e.second; }
+        }
+        ++misses;
+        hid_t key = H5Tcopy(src_type);
+        hid_t native = H5Tget_native_type(src_type, H5T_DIR_DEFAULT);
+        entries.emplace_back(key, native);
+        return native;
+    }
+    size_t hits = 0;
+    size_t misses = 0;
+private:
+    std::vector<std::pair<hid_t, hid_t>> entries;
+};
+
+// 目标文件的组句柄缓存：按绝对路径保存已打开的组，不存在时用 H5Lexists 判断后逐级创建
+class GroupCache {
+public:
+    explicit GroupCache(H5::H5File &file) : file(file) {}
+    Group get(const std::string &path) {
+        if (path.empty() || path == "/") return file.openGroup("/");
+        auto it = groups.find(path);
+        if (it != groups.end()) { ++hits; return it->second; }
+        ++misses;
+        size_t slash = path.find_last_of('/');
+        Group parent = get(slash == 0 ? "/" : path.substr(0, slash));
+        std::string name = path.substr(slash + 1);
+        Group g = H5Lexists(parent.getId(), name.c_str(), H5P_DEFAULT) > 0
+                      ? parent.openGroup(name) : parent.createGroup(name);
+        groups.emplace(path, g);
+        return g;
+    }
+    size_t hits = 0;
+    size_t misses = 0;
+private:
+    H5::H5File &file;
+    std::unordered_map<std::string, Group> groups;
+};
+
+// 合并布局的读取端：一次性加载索引，之后按 read_id 读取单条信号的切片
+// dapl 为 H5P_DEFAULT 时把 chunk cache 放大到至少一个 chunk：单条 read 远小于一个 chunk，
+// cache 放不下 chunk 时每次读取都要重新解压整个 chunk
+class ConsolidatedReader {
+public:
+    explicit ConsolidatedReader(H5::H5File &file, hid_t dapl = H5P_DEFAULT) {
+        hid_t idx = H5Dopen2(file.getId(), CONSOLIDATED_INDEX, H5P_DEFAULT);
+        if (idx < 0) return;
+        // 按文件中的字符串长度构造内存复合类型
+        hid_t ftype = H5Dget_type(idx);
+        hid_t fstr = H5Tget_member_type(ftype, 0);
+        size_t id_len = H5Tget_size(fstr);
+        hid_t str_t = H5Tcopy(H5T_C_S1);
+        H5Tset_size(str_t, id_len);
+        size_t rec = id_len + 2 * sizeof(uint64_t);
+        hid_t rec_t = H5Tcreate(H5T_COMPOUND, rec);
+        H5Tinsert(rec_t, "read_id", 0, str_t);
+        H5Tinsert(rec_t, "offset", id_len, H5T_NATIVE_UINT64);
+        H5Tinsert(rec_t, "length", id_len + sizeof(uint64_t), H5T_NATIVE_UINT64);
+        hid_t space = H5Dget_space(idx);
+        hssize_t nrec = H5Sget_simple_extent_npoints(space);
+        std::vector<char> recs(rec * static_cast<size_t>(nrec));
+        if (nrec > 0 && H5Dread(idx, rec_t, H5S_ALL, H5S_ALL, H5P_DEFAULT, recs.data()) >= 0) {
+            for (hssize_t i = 0; i < nrec; ++i) {
+                const char *r = recs.data() + i * rec;
+                uint64_t off, len;
+                std::memcpy(&off, r + id_len, sizeof(off));
+                std::memcpy(&len, r + id_len + sizeof(uint64_t), sizeof(len));
+                std::string id(r, strnlen(r, id_len));
+                ids.push_back(id);
+                index.emplace(std::move(id), std::make_pair(off, len));
+            }
+        }
+        H5Sclose(space);
+        H5Tclose(rec_t);
+        H5Tclose(str_t);
+        H5Tclose(fstr);
+        H5Tclose(ftype);
+        H5Dclose(idx);
+
+        sig = H5Dopen2(file.getId(), CONSOLIDATED_SIGNAL, dapl);
+        if (sig < 0) return;
+        if (dapl == H5P_DEFAULT) fit_chunk_cache(file);
+        hid_t stype = H5Dget_type(sig);
+        memtid = H5Tget_native_type(stype, H5T_DIR_DEFAULT);
+        H5Tclose(stype);
+    }
+    ~ConsolidatedReader() {
+        if (memtid >= 0) H5Tclose(memtid);
+        if (sig >= 0) H5Dclose(sig);
+    }
+    bool ok() const { return sig >= 0 && memtid >= 0; }
+    hid_t mem_type() const { return memtid; }
+
+    // 读取一条 read 的信号到 out，未找到或读取失败返回 false
+    bool fetch(const std::string &read_id, std::vector<char> &out) const {
+        auto it = index.find(read_id);
+        if (!ok() || it == index.end()) return false;
+        hsize_t off = it->second.first, len = it->second.second;
+        out.resize(static_cast<size_t>(len) * H5Tget_size(memtid));
+        hid_t fspace = H5Dget_space(sig);
+        H5Sselect_hyperslab(fspace, H5S_SELECT_SET, &off, nullptr, &len, nullptr);
+        hid_t mspace = H5Screate_simple(1, &len, nullptr);
+        herr_t err = H5Dread(sig, memtid, mspace, fspace, H5P_DEFAULT, out.data());
+        H5Sclose(mspace);
+        H5Sclose(fspace);
+        return err >= 0;
+    }
+
+    std::vector<std::string> ids;   // 按索引顺序排列的全部 read_id
+private:
+    // chunk 大于文件默认的 chunk cache 时，以能容纳一个 chunk 的 dapl 重新打开信号数据集
+    void fit_chunk_cache(H5::H5File &file) {
+        hid_t dcpl = H5Dget_create_plist(sig);
+        hsize_t chunk = 0;
+        bool chunked = H5Pget_layout(dcpl) == H5D_CHUNKED && H5Pget_chunk(dcpl, 1, &chunk) == 1;
+        H5Pclose(dcpl);
+        if (!chunked) return;
+        hid_t stype = H5Dget_type(sig);
+        size_t chunk_bytes = static_cast<size_t>(chunk) * H5Tget_size(stype);
+        H5Tclose(stype);
+        hid_t fapl = H5Fget_access_plist(file.getId());
+        int mdc_nelmts = 0;
+        size_t rdcc_nslots = 0, rdcc_nbytes = 0;
+        double rdcc_w0 = 0.0;
+        herr_t err = H5Pget_cache(fapl, &mdc_nelmts, &rdcc_nslots, &rdcc_nbytes, &rdcc_w0);
+        H5Pclose(fapl);
+        if (err < 0 || chunk_bytes <= rdcc_nbytes) return;
+        hid_t fitted = H5Pcreate(H5P_DATASET_ACCESS);
+        H5Pset_chunk_cache(fitted, H5D_CHUNK_CACHE_NSLOTS_DEFAULT, chunk_bytes, H5D_CHUNK_CACHE_W0_DEFAULT);
+        hid_t reopened = H5Dopen2(file.getId(), CONSOLIDATED_SIGNAL, fitted);
+        H5Pclose(fitted);
+        if (reopened < 0) return;
+        H5Dclose(sig);
+        sig = reopened;
+    }
+
+    hid_t sig = -1;
+    hid_t memtid = -1;
+    std::unordered_map<std::string, std::pair<hsize_t, hsize_t>> index;
+};
+
+// 合并布局的写入端：所有 read 的 Signal 依次追加到 /Consolidated/Signal，按整 chunk 写出；
+// 每条 read 在 /Consolidated/Index 中记录 (read_id, offset, length)，
+// 原 Signal 所在的组保留属性，并通过区域引用属性 Signal_ref 指向自己的切片
+// submit 非空时整 chunk 交给外部编码器写入，否则由 HDF5 过滤器在调用线程中写入
+class ConsolidatedWriter {
+public:
+    // 参数依次为合并数据集、chunk 起点、元素字节数和补 0 后的整 chunk 数据
+    using ChunkSubmit = std::function<void(const DataSet &, hsize_t, size_t, std::vector<char> &&)>;
+
+    ConsolidatedWriter(H5::H5File &file, GroupCache &groups, BufferPool &buffers, hsize_t chunk,
+                       const DSetCreatPropList &plist, ChunkSubmit submit = nullptr)
+        : file(file), groups(groups), buffers(buffers), chunk(chunk), plist(plist), submit(std::move(submit)) {}
+
+    // 尝试把一条一维 Signal 追加到合并数据集；创建失败或类型与首条不一致时返回 false，由调用者按原布局写入
+    bool append(const std::string &path, hid_t type, const std::vector<char> &buf, hsize_t nelem) {
+        if (failed) return false;
+        if (memtid < 0) {
+            hsize_t zero = 0, maxdim = H5S_UNLIMITED;
+            try {
+                Group g = groups.get(CONSOLIDATED_GROUP);
+                DataSpace space(1, &zero, &maxdim);
+                ds = g.createDataSet("Signal", DataType(type), space, plist);
+            } catch (...) {
+                ++g_exceptions_caught;
+                std::cerr << "Warning: failed to create " << CONSOLIDATED_SIGNAL << "\n";
+                failed = true;
+                return false;
+            }
+            // 创建成功后才记录类型，finish 以此判断合并数据集是否存在
+            memtid = type;
+            tsize = H5Tget_size(type);
+            staging = buffers.acquire(static_cast<size_t>(chunk) * tsize);
+        } else if (H5Tequal(memtid, type) <= 0) {
+            return false;
+        }
+        index.push_back({read_id_of(path), path.substr(0, path.find_last_of('/')), total, nelem});
+        // 逐段填充暂存区，满一个 chunk 就写出
+        const char *p = buf.data();
+        hsize_t left = nelem;
+        while (left > 0) {
+            hsize_t staged = total - flushed;
+            hsize_t take = std::min(left, chunk - staged);
+            std::memcpy(staging.data() + staged * tsize, p, static_cast<size_t>(take) * tsize);
+            p += take * tsize;
+            left -= take;
+            total += take;
+            if (total - flushed == chunk) flush(chunk);
+        }
+        return true;
+    }
+
+    // 写出剩余数据、索引和每条 read 的区域引用；交给 submit 的 chunk 由调用者负责等待写完
+    void finish() {
+        if (memtid < 0) return;
+        if (total > flushed) flush(total - flushed);
+        buffers.release(std::move(staging));
+
+        size_t id_len = 1;
+        for (auto &e : index) id_len = std::max(id_len, e.read_id.size());
+        hid_t str_t = H5Tcopy(H5T_C_S1);
+        H5Tset_size(str_t, id_len);
+        size_t rec = id_len + 2 * sizeof(uint64_t);
+        hid_t rec_t = H5Tcreate(H5T_COMPOUND, rec);
+        H5Tinsert(rec_t, "read_id", 0, str_t);
+        H5Tinsert(rec_t, "offset", id_len, H5T_NATIVE_UINT64);
+        H5Tinsert(rec_t, "length", id_len + sizeof(uint64_t), H5T_NATIVE_UINT64);
+        std::vector<char> recs(rec * index.size(), 0);
+        for (size_t i = 0; i < index.size(); ++i) {
+            char *r = recs.data() + i * rec;
+            const auto &e = index[i];
+            std::memcpy(r, e.read_id.data(), e.read_id.size());
+            uint64_t off = e.offset, len = e.length;
+            std::memcpy(r + id_len, &off, sizeof(off));
+            std::memcpy(r + id_len + sizeof(uint64_t), &len, sizeof(len));
+        }
+        hsize_t nrec = index.size();
+        hid_t space = H5Screate_simple(1, &nrec, nullptr);
+        Group g = groups.get(CONSOLIDATED_GROUP);
+        hid_t idx = H5Dcreate2(g.getId(), "Index", rec_t, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        if (idx < 0 || H5Dwrite(idx, rec_t, H5S_ALL, H5S_ALL, H5P_DEFAULT, recs.data()) < 0) {
+            std::cerr << "Warning: failed to write " << CONSOLIDATED_INDEX << "\n";
+        }
+        if (idx >= 0) H5Dclose(idx);
+        H5Sclose(space);
+        H5Tclose(rec_t);
+        H5Tclose(str_t);
+
+        // 区域引用属性
+        hid_t sig_space = H5Dget_space(ds.getId());
+        hid_t ref_space = H5Screate(H5S_SCALAR);
+        for (auto &e : index) {
+            hdset_reg_ref_t ref;
+            H5Sselect_hyperslab(sig_space, H5S_SELECT_SET, &e.offset, nullptr, &e.length, nullptr);
+            if (H5Rcreate(&ref, file.getId(), CONSOLIDATED_SIGNAL, H5R_DATASET_REGION, sig_space) < 0) continue;
+            Group rg = groups.get(e.group_path);
+            hid_t attr = H5Acreate2(rg.getId(), "Signal_ref", H5T_STD_REF_DSETREG, ref_space, H5P_DEFAULT, H5P_DEFAULT);
+            if (attr >= 0) {
+                H5Awrite(attr, H5T_STD_REF_DSETREG, &ref);
+                H5Aclose(attr);
+            }
+        }
+        H5Sclose(ref_space);
+        H5Sclose(sig_space);
+    }
+
+    double write_ms = 0.0;   // 不经 submit 时 H5Dwrite 写出各 chunk 的耗时
+private:
+    struct Entry {
+        std::string read_id;
+        std::string group_path;
+        hsize_t offset;
+        hsize_t length;
+    };
+
+    // 写出暂存区中的 n 个元素（除最后一次外总是一个完整 chunk）
+    void flush(hsize_t n) {
+        hsize_t off = flushed;
+        hsize_t extent = off + n;
+        H5Dset_extent(ds.getId(), &extent);
+        if (submit) {
+            // 与 HDF5 一致，末尾不满的 chunk 补 0 后整块编码
+            size_t chunk_bytes = static_cast<size_t>(chunk) * tsize;
+            std::memset(staging.data() + n * tsize, 0, chunk_bytes - n * tsize);
+            submit(ds, off, tsize, std::move(staging));
+            staging = buffers.acquire(chunk_bytes);
+        } else {
+            auto t1 = std::chrono::high_resolution_clock::now();
+            hid_t fspace = H5Dget_space(ds.getId());
+            H5Sselect_hyperslab(fspace, H5S_SELECT_SET, &off, nullptr, &n, nullptr);
+            hid_t mspace = H5Screate_simple(1, &n, nullptr);
+            herr_t err = H5Dwrite(ds.getId(), memtid, mspace, fspace, H5P_DEFAULT, staging.data());
+            H5Sclose(mspace);
+            H5Sclose(fspace);
+            auto t2 = std::chrono::high_resolution_clock::now();
+            write_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+            if (err < 0) std::cerr << "Warning: failed to write " << CONSOLIDATED_SIGNAL << "\n";
+        }
+        flushed += n;
+    }
+
+    H5::H5File &file;
+    GroupCache &groups;
+    BufferPool &buffers;
+    hsize_t chunk;               // chunk 元素数
+    DSetCreatPropList plist;
+    ChunkSubmit submit;
+    bool failed = false;
+    DataSet ds;
+    hid_t memtid = -1;           // 由 NativeTypeCache 持有
+    size_t tsize = 0;
+    hsize_t total = 0;           // 已追加的元素数
+    hsize_t flushed = 0;         // 已写入文件的元素数
+    std::vector<char> staging;   // 未满一个 chunk 的暂存数据
+    std::vector<Entry> index;
+};
+
 // 读取数据集的原始字节
+// pool 非空时缓冲区从池中获取；types 非空时 mem_type_id 由缓存持有，调用者不能关闭
 bool read_dataset_raw(H5::H5File &file, const std::string &path, std::vector<char> &outbuf,
-                      hid_t &mem_type_id, std::vector<hsize_t> &dims_out, H5::DataType &cpp_dtype) {
+                      hid_t &mem_type_id, std::vector<hsize_t> &dims_out, H5::DataType &cpp_dtype,
+                      BufferPool *pool = nullptr, NativeTypeCache *types = nullptr) {
     try {
         DataSet ds = file.openDataSet(path);
         DataSpace space = ds.getSpace();
@@ -88,64 +560,343 @@ bool read_dataset_raw(H5::H5File &file, const std::string &path, std::vector<cha
 
         //获取本机数据类型
         cpp_dtype = ds.getDataType();
-        hid_t native_tid = H5Tget_native_type(cpp_dtype.getId(), H5T_DIR_DEFAULT);
+        hid_t native_tid = types ? types->get(cpp_dtype.getId())
+                                 : H5Tget_native_type(cpp_dtype.getId(), H5T_DIR_DEFAULT);
         mem_type_id = native_tid;
 
         // 计算缓冲区大小
         hsize_t total = 1;
         for (auto d : dims_out) total *= d;
         size_t type_size = H5Tget_size(native_tid);
-        outbuf.resize(static_cast<size_t>(total) * type_size);
+        size_t nbytes = static_cast<size_t>(total) * type_size;
+        if (pool) outbuf = pool->acquire(nbytes);
+        else outbuf.resize(nbytes);
 
         herr_t err = H5Dread(ds.getId(), native_tid, H5S_ALL, H5S_ALL, H5P_DEFAULT, outbuf.data());
         if (err < 0) {
             std::cerr << "Error reading dataset: " << path << "\n";
-            H5Tclose(native_tid);
+            if (!types) H5Tclose(native_tid);
             return false;
         }
         return true;
     } catch (...) {
+        ++g_exceptions_caught;
         std::cerr << "Exception reading dataset: " << path << "\n";
         return false;
     }
 }
 
+// 创建数据集（父组不存在时逐级创建），不写入数据
+// groups 非空时通过组句柄缓存定位父组
+DataSet create_dataset(H5::H5File &dst, const std::string &path,
+                       hid_t mem_type_id, const std::vector<hsize_t> &dims,
+                       const DSetCreatPropList &plist, GroupCache *groups = nullptr) {
+    DataSpace space(static_cast<int>(dims.size()), dims.data());
+    DataType dtype(mem_type_id);
+    if (groups) {
+        size_t slash = path.find_last_of('/');
+        Group parent = groups->get(slash == 0 || slash == std::string::npos ? "/" : path.substr(0, slash));
+        return parent.createDataSet(path.substr(slash + 1), dtype, space, plist);
+    }
+    // 检查组是否存在，若不存在则创建
+    std::string p = path;
+    if (p.front() == '/') p.erase(0,1);
+    size_t pos = 0;
+    std::string cur = "";
+    while (true) {
+        size_t slash = p.find('/', pos);
+        std::string token = (slash==std::string::npos) ? p.substr(pos) : p.substr(pos, slash-pos);
+        pos = (slash==std::string::npos) ? std::string::npos : slash+1;
+        if (pos==std::string::npos) {
+            break;
+        }
+        cur += "/" + token;
+        if (H5Lexists(dst.getId(), cur.c_str(), H5P_DEFAULT) <= 0) {
+            dst.createGroup(cur);
+        }
+        if (pos==std::string::npos) break;
+    }
+    // 创建数据集
+    return dst.createDataSet(path, dtype, space, plist);
+}
+
 //创建并写入数据集
 bool create_and_write_dataset(H5::H5File &dst, const std::string &path,
                               hid_t mem_type_id, const std::vector<hsize_t> &dims,
-                              const std::vector<char> &buf, const DSetCreatPropList &plist) {
+                              const std::vector<char> &buf, const DSetCreatPropList &plist,
+                              GroupCache *groups = nullptr) {
     try {
-        // 检查组是否存在，若不存在则创建
-        std::string p = path;
-        if (p.front() == '/') p.erase(0,1);
-        size_t pos = 0;
-        std::string cur = "";
-        while (true) {
-            size_t slash = p.find('/', pos);
-            std::string token = (slash==std::string::npos) ? p.substr(pos) : p.substr(pos, slash-pos);
-            pos = (slash==std::string::npos) ? std::string::npos : slash+1;
-            if (pos==std::string::npos) {
-                break;
-            }
-            cur += "/" + token;
-            try {
-                Group g = dst.openGroup(cur);
-            } catch(...) {
-                dst.createGroup(cur);
-            }
-            if (pos==std::string::npos) break;
-        }
-        // 创建数据集
-        DataSpace space(static_cast<int>(dims.size()), dims.data());
-        DataType dtype(mem_type_id);
-        DataSet ds = dst.createDataSet(path, dtype, space, plist);
+        DataSet ds = create_dataset(dst, path, mem_type_id, dims, plist, groups);
         herr_t err = H5Dwrite(ds.getId(), mem_type_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf.data());
         return err >= 0;
     } catch (...) {
+        ++g_exceptions_caught;
         return false;
     }
 }
 
+// 目标数据集单个 chunk 的元素数上限，也是结果缓存键的一部分
+const hsize_t CHUNK_MAX_ELEMS = 1024*1024;
+
+// 目标数据集的 chunk 大小：各维度不断减半，直到单个 chunk 不超过 CHUNK_MAX_ELEMS 个元素
+std::vector<hsize_t> compute_chunk_dims(const std::vector<hsize_t> &dims) {
+    std::vector<hsize_t> chunk = dims;
+    if (chunk.size() == 0) chunk = {1};
+    hsize_t prod = 1;
+    for (auto d : chunk) prod *= (d>0?d:1);
+    while (prod > CHUNK_MAX_ELEMS) {
+        for (auto &c : chunk) {
+            if (c > 1) { c = (c+1)/2; }
+        }
+        prod = 1;
+        for (auto d : chunk) prod *= (d>0?d:1);
+    }
+    for (auto &c : chunk) if (c == 0) c = 1;
+    return chunk;
+}
+
+// 分块编码器：在 HDF5 之外完成过滤，输出必须能被对应 HDF5 过滤器链解码，
+// 结果由 H5Dwrite_chunk 直接写入。编码器只做纯内存计算，可以在工作线程中运行
+using ChunkEncoder = std::function<bool(const char *in, size_t nbytes, size_t elem_size, std::vector<char> &out)>;
+
+// 与 H5Z_FILTER_SHUFFLE 相同的字节重排：按字节位置分组，尾部不足一个元素的字节原样保留
+void shuffle_bytes(const char *in, size_t nbytes, size_t elem_size, char *out) {
+    if (elem_size <= 1) {
+        std::memcpy(out, in, nbytes);
+        return;
+    }
+    size_t nelem = nbytes / elem_size;
+    for (size_t b = 0; b < elem_size; ++b) {
+        char *dst = out + b * nelem;
+        const char *src = in + b;
+        for (size_t i = 0; i < nelem; ++i) dst[i] = src[i * elem_size];
+    }
+    size_t tail = nelem * elem_size;
+    std::memcpy(out + tail, in + tail, nbytes - tail);
+}
+
+// shuffle + deflate 编码器，等价于 p.setShuffle(); p.setDeflate(level);
+// H5Z_FILTER_DEFLATE 内部同样调用 zlib compress2，因此输出可被任何标准读取端解码
+ChunkEncoder make_shuffle_deflate_encoder(int level) {
+    return [level](const char *in, size_t nbytes, size_t elem_size, std::vector<char> &out) {
+        std::vector<char> shuffled(nbytes);
+        shuffle_bytes(in, nbytes, elem_size, shuffled.data());
+        uLongf out_len = compressBound(static_cast<uLong>(nbytes));
+        out.resize(out_len);
+        int zr = compress2(reinterpret_cast<Bytef*>(out.data()), &out_len,
+                           reinterpret_cast<const Bytef*>(shuffled.data()), static_cast<uLong>(nbytes), level);
+        if (zr != Z_OK) return false;
+        out.resize(out_len);
+        return true;
+    };
+}
+
+// 运行时加载的 libdeflate。它的 zlib 格式输出是标准 deflate 流，任何 zlib inflate 都能解码，
+// 但与 zlib compress2 的输出不逐字节相同。库不存在时 ok() 为 false，对应的 spec 不参与测试
+class LibDeflate {
+public:
+    static LibDeflate &instance() {
+        static LibDeflate lib;
+        return lib;
+    }
+    bool ok() const { return handle_ != nullptr; }
+
+    // 压缩器不能跨线程共享，每个线程按级别各持有一个
+    bool zlib_compress(int level, const void *in, size_t nbytes, std::vector<char> &out) {
+        thread_local Compressors local;
+        void *&c = local.by_level[level];
+        if (!c) {
+            c = alloc_(level);
+            if (!c) return false;
+            local.free = free_;
+        }
+        out.resize(bound_(c, nbytes));
+        size_t n = compress_(c, in, nbytes, out.data(), out.size());
+        if (n == 0) return false;
+        out.resize(n);
+        return true;
+    }
+
+private:
+    using AllocFn = void *(*)(int);
+    using CompressFn = size_t (*)(void *, const void *, size_t, void *, size_t);
+    using BoundFn = size_t (*)(void *, size_t);
+    using FreeFn = void (*)(void *);
+
+    struct Compressors {
+        std::unordered_map<int, void *> by_level;
+        FreeFn free = nullptr;
+        ~Compressors() {
+            for (auto &kv : by_level) if (kv.second && free) free(kv.second);
+        }
+    };
+
+    LibDeflate() {
+        for (const char *name : {"libdeflate.so.0", "libdeflate.so"}) {
+            handle_ = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+            if (handle_) break;
+        }
+        if (!handle_) return;
+        alloc_ = reinterpret_cast<AllocFn>(dlsym(handle_, "libdeflate_alloc_compressor"));
+        compress_ = reinterpret_cast<CompressFn>(dlsym(handle_, "libdeflate_zlib_compress"));
+        bound_ = reinterpret_cast<BoundFn>(dlsym(handle_, "libdeflate_zlib_compress_bound"));
+        free_ = reinterpret_cast<FreeFn>(dlsym(handle_, "libdeflate_free_compressor"));
+        if (!alloc_ || !compress_ || !bound_ || !free_) {
+            dlclose(handle_);
+            handle_ = nullptr;
+        }
+    }
+
+    void *handle_ = nullptr;
+    AllocFn alloc_ = nullptr;
+    CompressFn compress_ = nullptr;
+    BoundFn bound_ = nullptr;
+    FreeFn free_ = nullptr;
+};
+
+// shuffle + libdeflate 编码器，过滤器管线与 make_shuffle_deflate_encoder 相同（H5Z_FILTER_DEFLATE），
+// 读取端仍使用标准 deflate 过滤器解码
+ChunkEncoder make_shuffle_libdeflate_encoder(int level) {
+    return [level](const char *in, size_t nbytes, size_t elem_size, std::vector<char> &out) {
+        std::vector<char> shuffled(nbytes);
+        shuffle_bytes(in, nbytes, elem_size, shuffled.data());
+        return LibDeflate::instance().zlib_compress(level, shuffled.data(), nbytes, out);
+    };
+}
+
+// 从行主序的整块数据中取出一个 chunk，超出数据集边界的部分补 0（与 HDF5 的边缘 chunk 一致）
+void gather_chunk(const char *src, const std::vector<hsize_t> &dims, const std::vector<hsize_t> &chunk,
+                  const std::vector<hsize_t> &offset, size_t tsize, char *out) {
+    size_t rank = dims.size();
+    hsize_t chunk_elems = 1;
+    for (auto c : chunk) chunk_elems *= c;
+    std::memset(out, 0, static_cast<size_t>(chunk_elems) * tsize);
+    if (rank == 0) {
+        std::memcpy(out, src, tsize);
+        return;
+    }
+    // 最内层维度连续拷贝，外层维度逐行遍历
+    hsize_t inner = std::min(chunk[rank-1], dims[rank-1] - offset[rank-1]);
+    std::vector<hsize_t> idx(rank - 1, 0);
+    while (true) {
+        bool inside = true;
+        size_t src_off = 0, dst_off = 0;
+        for (size_t d = 0; d + 1 < rank; ++d) {
+            hsize_t g = offset[d] + idx[d];
+            if (g >= dims[d]) { inside = false; break; }
+            src_off = src_off * dims[d] + g;
+            dst_off = dst_off * chunk[d] + idx[d];
+        }
+        if (inside) {
+            src_off = src_off * dims[rank-1] + offset[rank-1];
+            dst_off = dst_off * chunk[rank-1];
+            std::memcpy(out + dst_off * tsize, src + src_off * tsize, static_cast<size_t>(inner) * tsize);
+        }
+        // 外层索引进位
+        size_t d = rank - 1;
+        while (d > 0) {
+            --d;
+            if (++idx[d] < chunk[d]) break;
+            idx[d] = 0;
+            if (d == 0) return;
+        }
+        if (rank == 1) return;
+    }
+}
+
+// 压缩工作线程池：只执行纯内存编码，所有 HDF5 调用都留在主线程
+class EncodePool {
+public:
+    explicit EncodePool(unsigned nthreads) {
+        if (nthreads == 0) nthreads = 1;
+        for (unsigned i = 0; i < nthreads; ++i) {
+            workers.emplace_back([this]{
+                while (true) {
+                    std::function<void()> job;
+                    {
+                        std::unique_lock<std::mutex> lk(mu);
+                        cv.wait(lk, [this]{ return stop || !jobs.empty(); });
+                        if (stop && jobs.empty()) return;
+                        job = std::move(jobs.front());
+                        jobs.pop_front();
+                    }
+                    job();
+                }
+            });
+        }
+    }
+    ~EncodePool() {
+        {
+            std::lock_guard<std::mutex> lk(mu);
+            stop = true;
+        }
+        cv.notify_all();
+        for (auto &t : workers) t.join();
+    }
+    // 提交一个任务，返回的 future 携带任务耗时（毫秒）
+    std::future<double> submit(std::function<bool()> fn) {
+        auto task = std::make_shared<std::packaged_task<double()>>([fn]{
+            auto t1 = std::chrono::high_resolution_clock::now();
+            bool ok = fn();
+            auto t2 = std::chrono::high_resolution_clock::now();
+            return ok ? std::chrono::duration<double, std::milli>(t2 - t1).count() : -1.0;
+        });
+        std::future<double> fut = task->get_future();
+        {
+            std::lock_guard<std::mutex> lk(mu);
+            jobs.emplace_back([task]{ (*task)(); });
+        }
+        cv.notify_one();
+        return fut;
+    }
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mu;
+    std::condition_variable cv;
+    bool stop = false;
+};
+
+// 流水线中等待写入的数据集：源数据缓冲区在编码完成前必须保持存活
+struct PendingWrite {
+    std::string path;
+    DataSet ds;
+    std::vector<char> buf;
+    std::vector<std::vector<hsize_t>> offsets;
+    std::vector<std::vector<char>> encoded;
+    std::vector<std::future<double>> done;
+};
+
+// 一个压缩测试配置
+struct FilterSpec {
+    std::string name;
+    std::function<void(DSetCreatPropList&)> apply;
+    bool requires_avail; // 是否需要检测可用性
+    unsigned int check_id; // 插件过滤器ID
+    ChunkEncoder encode = nullptr; // 非空时目标数据集在工作线程中编码，再经 H5Dwrite_chunk 写入
+    bool encoder_only = false;     // 输出只能由 encode 生成（HDF5 自身的过滤器给不出同样的结果）
+};
+
+// 为目标数据集配置 chunk 和过滤器；filter_ok 为 false 时只分块不压缩
+DSetCreatPropList build_target_plist(const FilterSpec &spec, bool filter_ok,
+                                     const std::vector<hsize_t> &chunk, const std::string &path) {
+    DSetCreatPropList plist;
+    plist.setChunk((unsigned)chunk.size(), chunk.data());
+    // 应用过滤器
+    if (filter_ok) {
+        // // 设置 SZIP 选项
+        if (spec.check_id == H5Z_FILTER_SZIP) {
+            herr_t r = H5Pset_szip(plist.getId(), H5_SZIP_NN_OPTION_MASK, 16);
+            if (r < 0) {
+                std::cerr << "Warning: failed to set SZIP options for " << path << "\n";
+            }
+        } else {
+            spec.apply((DSetCreatPropList&)plist);
+        }
+    }
+    return plist;
+}
+
 // 非解压对象,直接复制保持不变
 bool copy_object_as_is(H5::H5File &src, H5::H5File &dst, const std::string &path) {
     try {
@@ -190,73 +941,561 @@ bool copy_object_as_is(H5::H5File &src, H5::H5File &dst, const std::string &path
     }
 }
 
-int main(int argc, char **argv) {
-    if (argc < 3) {
-        std::cout << "Usage: " << argv[0] << " <source.h5> <out-dir>\n";
-        std::cout << "Example: " << argv[0] << " data.h5 out\n";
-        return 1;
+// 丢弃文件在页缓存中的数据（先落盘，否则脏页不会被丢弃）；无权限或不支持时返回 false
+bool drop_page_cache(const fs::path &file) {
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    ::fsync(fd);
+    bool ok = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    ::close(fd);
+    return ok;
+}
+
+// 由一组延迟样本计算 p50 / p99 和吞吐
+LatencyStats summarize_latency(std::vector<double> &samples_ms) {
+    LatencyStats st;
+    if (samples_ms.empty()) return st;
+    std::sort(samples_ms.begin(), samples_ms.end());
+    auto pct = [&](double q) {
+        size_t i = static_cast<size_t>(q * (samples_ms.size() - 1) + 0.5);
+        return samples_ms[std::min(i, samples_ms.size() - 1)];
+    };
+    st.p50_ms = pct(0.50);
+    st.p99_ms = pct(0.99);
+    double total_ms = 0.0;
+    for (double v : samples_ms) total_ms += v;
+    st.reads_per_s = total_ms > 0 ? samples_ms.size() * 1000.0 / total_ms : 0.0;
+    return st;
+}
+
+// 输出文件的随机读取基准：随机抽取 k 条 read 的 Signal，分别测冷读和热读延迟
+// 合并布局的文件通过 ConsolidatedReader 按 read_id 读取；dapl 用于配置 chunk cache，
+// 为 H5P_DEFAULT 时由 ConsolidatedReader 自行放大到一个 chunk
+void bench_random_access(const fs::path &file, size_t k, hid_t dapl, unsigned seed, Result &r) {
+    // 收集可读取的 read：合并布局索引中的 read_id，以及仍按每读布局保存的 Raw/Signal 数据集的绝对路径
+    // （合并布局中类型与首条不一致的 read 也保留原布局）。read_id 不以 '/' 开头，以此区分两类键
+    std::vector<std::string> keys;
+    bool consolidated = false;
+    {
+        H5::H5File f(file.string(), H5F_ACC_RDONLY);
+        ConsolidatedReader reader(f, dapl);
+        if (reader.ok() && !reader.ids.empty()) {
+            consolidated = true;
+            keys = reader.ids;
+        }
+        H5Ovisit(f.getId(), H5_INDEX_NAME, H5_ITER_INC,
+                 [](hid_t, const char *name, const H5O_info_t *info, void *op) -> herr_t {
+                     std::string path = std::string("/") + name;
+                     std::string base = path.substr(path.find_last_of('/') + 1);
+                     if (info->type == H5O_TYPE_DATASET && base == "Signal" && is_target_dataset(path, base)) {
+                         static_cast<std::vector<std::string>*>(op)->push_back(path);
+                     }
+                     return 0;
+                 }, &keys);
     }
-    std::string src_path = argv[1];
-    fs::path outdir = argv[2];
-    fs::create_directories(outdir);
+    if (keys.empty()) return;
 
-    // 插件过滤器需要在运行前注册
-    struct FilterSpec {
-        std::string name;
-        std::function<void(DSetCreatPropList&)> apply;
-        bool requires_avail; // 是否需要检测可用性
-        unsigned int check_id; // 插件过滤器ID
+    std::mt19937 rng(seed);
+    std::vector<std::string> picks(k);
+    for (auto &p : picks) p = keys[rng() % keys.size()];
+
+    std::vector<char> buf;
+    // 读取一条 read，返回耗时（毫秒），失败返回负数
+    auto fetch_one = [&](H5::H5File &f, const ConsolidatedReader *reader, const std::string &key) -> double {
+        auto t1 = std::chrono::high_resolution_clock::now();
+        bool ok;
+        if (consolidated && key.front() != '/') {
+            ok = reader->fetch(key, buf);
+        } else {
+            hid_t ds = H5Dopen2(f.getId(), key.c_str(), dapl);
+            ok = ds >= 0;
+            if (ok) {
+                hid_t ftype = H5Dget_type(ds);
+                hid_t ntype = H5Tget_native_type(ftype, H5T_DIR_DEFAULT);
+                hid_t space = H5Dget_space(ds);
+                buf.resize(static_cast<size_t>(H5Sget_simple_extent_npoints(space)) * H5Tget_size(ntype));
+                ok = H5Dread(ds, ntype, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf.data()) >= 0;
+                H5Sclose(space);
+                H5Tclose(ntype);
+                H5Tclose(ftype);
+                H5Dclose(ds);
+            }
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        return ok ? std::chrono::duration<double, std::milli>(t2 - t1).count() : -1.0;
     };
-    std::vector<FilterSpec> specs;
 
-    // 基线文件
-    specs.push_back({"baseline_none", [](DSetCreatPropList &p){ /* no change */ }, false, 0});
+    // 冷读：每次重新打开文件，打开前丢弃页缓存；合并布局的 ConsolidatedReader 构造（加载索引、打开 Signal）
+    // 计入延迟，与每读布局中计入的 H5Dopen2 对应
+    std::vector<double> samples;
+    bool dropped = true;
+    for (const auto &key : picks) {
+        dropped = drop_page_cache(file) && dropped;
+        H5::H5File f(file.string(), H5F_ACC_RDONLY);
+        std::unique_ptr<ConsolidatedReader> reader;
+        double open_ms = 0.0;
+        if (consolidated && key.front() != '/') {
+            auto t1 = std::chrono::high_resolution_clock::now();
+            reader = std::make_unique<ConsolidatedReader>(f, dapl);
+            auto t2 = std::chrono::high_resolution_clock::now();
+            open_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        }
+        double ms = fetch_one(f, reader.get(), key);
+        if (ms >= 0) samples.push_back(open_ms + ms);
+    }
+    r.cold = summarize_latency(samples);
+    if (!dropped) std::cerr << "Warning: could not drop page cache for " << file << "; cold numbers include cached pages\n";
 
-    // shuffle + gzip levels 1,6,9
-    unsigned int gzip_cp_levs[3] = {1,6,9};
-    for (unsigned int lev : gzip_cp_levs) {
-        std::string fname = "shuffle_gzip_lvl" + std::to_string(lev);
-        specs.push_back({fname, [lev](DSetCreatPropList &p){ p.setShuffle(); p.setDeflate(lev); }, false, H5Z_FILTER_DEFLATE});
+    // 热读：文件保持打开，先按同一顺序预热一遍，再按新的随机顺序计时
+    samples.clear();
+    {
+        H5::H5File f(file.string(), H5F_ACC_RDONLY);
+        std::unique_ptr<ConsolidatedReader> reader;
+        if (consolidated) reader = std::make_unique<ConsolidatedReader>(f, dapl);
+        for (const auto &key : picks) fetch_one(f, reader.get(), key);
+        std::shuffle(picks.begin(), picks.end(), rng);
+        for (const auto &key : picks) {
+            double ms = fetch_one(f, reader.get(), key);
+            if (ms >= 0) samples.push_back(ms);
+        }
     }
-    // szip
-#ifdef H5Z_FILTER_SZIP
-    specs.push_back({"szip", [](DSetCreatPropList &p){
-    }, true, H5Z_FILTER_SZIP});
+    r.warm = summarize_latency(samples);
+}
+
+// 单个目标数据集的信号统计
+struct SignalProfile {
+    std::string path;
+    uint64_t samples = 0;
+    int64_t min = 0;
+    int64_t max = 0;
+    unsigned bit_width = 0;      // 表示取值范围 max-min 所需的位数
+    double h0_bits = 0.0;        // 样本的零阶熵（bit/样本）
+    double h0_delta_bits = 0.0;  // 一阶差分的零阶熵（bit/样本）
+    double mean_run = 0.0;       // 相同取值连续出现的平均长度
+    uint64_t raw_bytes = 0;
+    uint64_t bound_bytes = 0;    // 按两种零阶熵中较小者估计的压缩下界
+    bool anomalous = false;
+};
+
+// 单遍信号统计：最值、样本/差分零阶熵、游程、有效位宽
+// 直方图使用 4 路独立子表交错累加，避免相邻样本落在同一 bin 时的读写依赖
+class SignalProfiler {
+public:
+    // 仅支持整数类型，其他类型返回 false
+    bool profile(const char *buf, size_t nelem, hid_t memtid, SignalProfile &out) {
+        if (H5Tget_class(memtid) != H5T_INTEGER || nelem == 0) return false;
+        bool is_signed = H5Tget_sign(memtid) == H5T_SGN_2;
+        size_t tsize = H5Tget_size(memtid);
+        out.samples = nelem;
+        out.raw_bytes = static_cast<uint64_t>(nelem) * tsize;
+        switch (tsize) {
+            case 1: is_signed ? run(reinterpret_cast<const int8_t*>(buf), nelem, out)
+                              : run(reinterpret_cast<const uint8_t*>(buf), nelem, out); break;
+            case 2: is_signed ? run(reinterpret_cast<const int16_t*>(buf), nelem, out)
+                              : run(reinterpret_cast<const uint16_t*>(buf), nelem, out); break;
+            case 4: is_signed ? run(reinterpret_cast<const int32_t*>(buf), nelem, out)
+                              : run(reinterpret_cast<const uint32_t*>(buf), nelem, out); break;
+            case 8: is_signed ? run(reinterpret_cast<const int64_t*>(buf), nelem, out)
+                              : run(reinterpret_cast<const uint64_t*>(buf), nelem, out); break;
+            default: return false;
+        }
+        double best = std::min(out.h0_bits, out.h0_delta_bits);
+        out.bound_bytes = static_cast<uint64_t>(std::ceil(best * nelem / 8.0));
+        return true;
+    }
+
+private:
+    static const int64_t MAX_BINS = int64_t(1) << 22;
+
+    template <typename T>
+    void run(const T *x, size_t n, SignalProfile &out) {
+        // 最值：无分支循环，便于编译器向量化
+        T lo = x[0], hi = x[0];
+        for (size_t i = 1; i < n; ++i) {
+            lo = x[i] < lo ? x[i] : lo;
+            hi = x[i] > hi ? x[i] : hi;
+        }
+        out.min = static_cast<int64_t>(lo);
+        out.max = static_cast<int64_t>(hi);
+        // 范围和下标都用无符号运算：64 位数据的 hi - lo 可能超出 int64_t
+        uint64_t range = static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo);
+        out.bit_width = 0;
+        while (out.bit_width < 64 && (range >> out.bit_width) != 0) ++out.bit_width;
+
+        // 样本直方图
+        if (range < static_cast<uint64_t>(MAX_BINS)) {
+            size_t bins = static_cast<size_t>(range) + 1;
+            out.h0_bits = histogram_entropy(n, bins, [&](size_t i) {
+                return static_cast<size_t>(static_cast<uint64_t>(x[i]) - static_cast<uint64_t>(lo));
+            });
+        } else {
+            // 范围过大时改用排序计数，结果与直方图相同
+            out.h0_bits = sparse_entropy(n, [&](size_t i) {
+                return static_cast<uint64_t>(x[i]) - static_cast<uint64_t>(lo);
+            });
+        }
+
+        // 一阶差分直方图，差分范围为 [-range, range]
+        size_t changes = 0;
+        for (size_t i = 1; i < n; ++i) changes += x[i] != x[i-1];
+        out.mean_run = static_cast<double>(n) / static_cast<double>(changes + 1);
+        if (n < 2) {
+            out.h0_delta_bits = out.h0_bits;
+        } else if (range < static_cast<uint64_t>(MAX_BINS / 2)) {
+            size_t bins = 2 * static_cast<size_t>(range) + 1;
+            // 第一个样本原样保存，其余按差分计；模 2^64 运算后加 range 落在 [0, 2*range]
+            double h = histogram_entropy(n - 1, bins, [&](size_t i) {
+                return static_cast<size_t>(static_cast<uint64_t>(x[i+1]) - static_cast<uint64_t>(x[i]) + range);
+            });
+            out.h0_delta_bits = (h * (n - 1) + out.bit_width) / n;
+        } else {
+            // 模 2^64 的差分与原差分一一对应，可直接作为排序键
+            double h = sparse_entropy(n - 1, [&](size_t i) {
+                return static_cast<uint64_t>(x[i+1]) - static_cast<uint64_t>(x[i]);
+            });
+            out.h0_delta_bits = (h * (n - 1) + out.bit_width) / n;
+        }
+    }
+
+    // 对 bin(i), i∈[0,n) 建立直方图并返回零阶熵（bit/样本）
+    template <typename BinFn>
+    double histogram_entropy(size_t n, size_t bins, BinFn bin) {
+        lanes.assign(4 * bins, 0);
+        uint32_t *l0 = lanes.data(), *l1 = l0 + bins, *l2 = l1 + bins, *l3 = l2 + bins;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            ++l0[bin(i)];
+            ++l1[bin(i+1)];
+            ++l2[bin(i+2)];
+            ++l3[bin(i+3)];
+        }
+        for (; i < n; ++i) ++l0[bin(i)];
+        double h = 0.0;
+        double inv = 1.0 / static_cast<double>(n);
+        for (size_t b = 0; b < bins; ++b) {
+            uint64_t c = uint64_t(l0[b]) + l1[b] + l2[b] + l3[b];
+            if (c == 0) continue;
+            double p = c * inv;
+            h -= p * std::log2(p);
+        }
+        return h;
+    }
+
+    // 稀疏直方图：对 key(i), i∈[0,n) 排序后按游程计数，返回零阶熵（bit/样本）
+    template <typename KeyFn>
+    double sparse_entropy(size_t n, KeyFn key) {
+        keys.resize(n);
+        for (size_t i = 0; i < n; ++i) keys[i] = key(i);
+        std::sort(keys.begin(), keys.end());
+        double h = 0.0;
+        double inv = 1.0 / static_cast<double>(n);
+        for (size_t i = 0; i < n;) {
+            size_t j = i + 1;
+            while (j < n && keys[j] == keys[i]) ++j;
+            double p = (j - i) * inv;
+            h -= p * std::log2(p);
+            i = j;
+        }
+        return h;
+    }
+
+    std::vector<uint32_t> lanes;
+    std::vector<uint64_t> keys;
+};
+
+// 按每样本下界位数的中位数和 MAD 标记离群 read
+void flag_anomalies(std::vector<SignalProfile> &profiles) {
+    std::vector<double> bits;
+    for (auto &p : profiles) bits.push_back(p.samples ? 8.0 * p.bound_bytes / p.samples : 0.0);
+    if (bits.size() < 3) return;
+    std::vector<double> sorted = bits;
+    std::sort(sorted.begin(), sorted.end());
+    double med = sorted[sorted.size() / 2];
+    std::vector<double> dev;
+    for (double b : bits) dev.push_back(std::fabs(b - med));
+    std::sort(dev.begin(), dev.end());
+    double mad = dev[dev.size() / 2];
+    double tol = std::max(5.0 * 1.4826 * mad, 0.25);
+    for (size_t i = 0; i < profiles.size(); ++i) profiles[i].anomalous = std::fabs(bits[i] - med) > tol;
+}
+
+// 源文件标识：大小 + 修改时间 + 内容 CRC32，任一变化都会使结果缓存失效
+std::string source_identity(const fs::path &file) {
+    struct stat st;
+    if (::stat(file.c_str(), &st) != 0) throw std::runtime_error("stat failed: " + file.string());
+    std::ostringstream id;
+    id << "size=" << st.st_size << ";mtime=" << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+    std::ifstream in(file, std::ios::binary);
+    std::vector<char> block(4 * 1024 * 1024);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    while (in) {
+        in.read(block.data(), static_cast<std::streamsize>(block.size()));
+        std::streamsize got = in.gcount();
+        if (got <= 0) break;
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(block.data()), static_cast<uInt>(got));
+    }
+    id << ";crc32=" << std::hex << crc;
+    return id.str();
+}
+
+// Result 的 TAB 分隔文本形式，结果缓存和 MPI 结果汇总共用
+// 字段依次为 filter, file_mb, compress_ms, wall_ms, encode_cpu_ms, cold x3, warm x3, mem x7
+const size_t RESULT_TSV_FIELDS = 18;
+
+std::string result_to_tsv(const Result &r) {
+    std::ostringstream out;
+    out << r.filter_name << "\t" << r.file_mb << "\t" << r.compress_ms << "\t" << r.wall_ms << "\t"
+        << r.encode_cpu_ms << "\t" << r.cold.p50_ms << "\t" << r.cold.p99_ms << "\t" << r.cold.reads_per_s << "\t"
+        << r.warm.p50_ms << "\t" << r.warm.p99_ms << "\t" << r.warm.reads_per_s << "\t"
+        << r.mem.rss_peak_delta_mb << "\t" << r.mem.rss_peak_mb << "\t" << r.mem.tool_alloc_bytes << "\t" << r.mem.tool_peak_live_bytes << "\t"
+        << r.mem.h5_free_list_bytes << "\t" << r.mem.mdc_bytes << "\t" << r.mem.chunk_cache_bytes;
+    return out.str();
+}
+
+// 从 f[first] 开始解析 RESULT_TSV_FIELDS 个字段，格式错误时返回 false
+bool result_from_tsv(const std::vector<std::string> &f, size_t first, Result &r) {
+    if (f.size() != first + RESULT_TSV_FIELDS) return false;
+    try {
+        r.filter_name = f[first];
+        r.file_mb = std::stoull(f[first + 1]);
+        r.ratio = 0.0;
+        r.compress_ms = std::stod(f[first + 2]);
+        r.wall_ms = std::stod(f[first + 3]);
+        r.encode_cpu_ms = std::stod(f[first + 4]);
+        r.cold = {std::stod(f[first + 5]), std::stod(f[first + 6]), std::stod(f[first + 7])};
+        r.warm = {std::stod(f[first + 8]), std::stod(f[first + 9]), std::stod(f[first + 10])};
+        r.mem = {std::stod(f[first + 11]), std::stod(f[first + 12]), std::stoull(f[first + 13]),
+                 std::stoull(f[first + 14]), std::stoull(f[first + 15]), std::stoull(f[first + 16]),
+                 std::stoull(f[first + 17])};
+        return true;
+    } catch (...) {
+        ++g_exceptions_caught;
+        return false;
+    }
+}
+
+std::vector<std::string> split_tsv(const std::string &line) {
+    std::vector<std::string> f;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, '\t')) f.push_back(field);
+    return f;
+}
+
+// 结果缓存：以追加方式记录每个已完成的 spec，中断后重新运行会跳过已记录且配置一致的 spec
+// 每行依次为 source_id, spec_key, bench_key 和 result_to_tsv 的字段
+// 读取目录下全部 hdf5_results_cache*.tsv（MPI 下每个 rank 各写一个文件），只追加到 write_name
+class ResultsCache {
+public:
+    struct Entry {
+        std::string bench_key;
+        Result result;
+    };
+
+    ResultsCache(const fs::path &dir, const std::string &write_name, const std::string &source_id)
+        : file(dir / write_name), source_id(source_id) {
+        std::vector<fs::path> files;
+        for (const auto &de : fs::directory_iterator(dir)) {
+            std::string fname = de.path().filename().string();
+            if (fname.rfind("hdf5_results_cache", 0) == 0 && de.path().extension() == ".tsv") files.push_back(de.path());
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto &path : files) {
+            std::ifstream in(path);
+            std::string line;
+            while (std::getline(in, line)) {
+                std::vector<std::string> f = split_tsv(line);
+                if (f.size() < 3 || f[0] != source_id) continue;
+                Entry e;
+                e.bench_key = f[2];
+                if (result_from_tsv(f, 3, e.result)) entries[f[1]] = e;  // 后写入的行覆盖先前的结果
+            }
+        }
+    }
+
+    const Entry *find(const std::string &spec_key) const {
+        auto it = entries.find(spec_key);
+        return it == entries.end() ? nullptr : &it->second;
+    }
+
+    // 追加一行并立即刷新，保证中断时已完成的 spec 不丢失
+    void store(const std::string &spec_key, const std::string &bench_key, const Result &r) {
+        entries[spec_key] = Entry{bench_key, r};
+        std::ofstream out(file, std::ios::app);
+        out << source_id << "\t" << spec_key << "\t" << bench_key << "\t" << result_to_tsv(r) << "\n";
+        out.flush();
+    }
+
+private:
+    fs::path file;
+    std::string source_id;
+    std::unordered_map<std::string, Entry> entries;
+};
+
+// MPI 运行环境；未启用 MPI 构建时等价于只有一个 rank
+class MpiSession {
+public:
+    MpiSession(int &argc, char **&argv) {
+#ifdef USE_MPI
+        MPI_Init(&argc, &argv);
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank_);
+        MPI_Comm_size(MPI_COMM_WORLD, &size_);
+        // 同一节点上的 rank 数，用于平分本机核数
+        MPI_Comm node;
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank_, MPI_INFO_NULL, &node);
+        MPI_Comm_size(node, &local_size_);
+        MPI_Comm_free(&node);
 #else
-    specs.push_back({"szip", [](DSetCreatPropList &p){}, true, H5Z_FILTER_SZIP});
+        (void)argc;
+        (void)argv;
 #endif
+    }
+    ~MpiSession() {
+#ifdef USE_MPI
+        MPI_Finalize();
+#endif
+    }
+    int rank() const { return rank_; }
+    int size() const { return size_; }
+    int local_size() const { return local_size_; }
 
-    // vbz levels 1,11,22
-    /*unsigned int vbz_cp_levs[3] = {1,11,22};
-    for (unsigned int lev : vbz_cp_levs) {
-        std::string fname = "shuffle_vbz_lvl" + std::to_string(lev);
-        unsigned int cd_vals[4] = {0, lev, 1, 1};
-        specs.push_back(
-            {fname,
-            [cd_vals](DSetCreatPropList &p){
-                p.setFilter(FILTER_VBZ_ID, H5Z_FLAG_MANDATORY , 4, cd_vals);
-            },
-            true,      
-            FILTER_VBZ_ID
-        });
-    }*/
+    // 把各 rank 的文本按 rank 顺序拼接到 rank 0，其他 rank 返回空串
+    std::string gather(const std::string &local) const {
+#ifdef USE_MPI
+        int len = static_cast<int>(local.size());
+        std::vector<int> lens(size_), offs(size_, 0);
+        MPI_Gather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        std::string all;
+        if (rank_ == 0) {
+            for (int r = 1; r < size_; ++r) offs[r] = offs[r-1] + lens[r-1];
+            all.resize(static_cast<size_t>(offs[size_-1] + lens[size_-1]));
+        }
+        MPI_Gatherv(local.data(), len, MPI_CHAR, &all[0], lens.data(), offs.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+        return all;
+#else
+        return local;
+#endif
+    }
 
-    // lz4 (no level setting)
-    specs.push_back({"lz4", [](DSetCreatPropList &p){
-        p.setFilter(H5Z_FILTER_LZ4 , H5Z_FLAG_MANDATORY, 0, nullptr);
-    }, true, H5Z_FILTER_LZ4 });
+private:
+    int rank_ = 0;
+    int size_ = 1;
+    int local_size_ = 1;
+};
 
-    // zstd 
-    unsigned int levels[3] = {1, 11, 22};
-    for (unsigned int lev : levels) {
-        std::string fname = "zstd_lvl" + std::to_string(lev);
-        specs.push_back({fname, [lev](DSetCreatPropList &p){
-            p.setFilter(H5Z_FILTER_ZSTD, H5Z_FLAG_MANDATORY , 1,&lev);
-        }, true, H5Z_FILTER_ZSTD });
+// 命令行可选参数
+struct SweepOptions {
+    unsigned int n_threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t pipeline_depth = 0;
+    std::string layout = "per-read";
+    hsize_t signal_chunk = 1024*1024;   // 偏向压缩比和顺序扫描；随机按 read 读取时每次都要解压整个 chunk
+    size_t bench_reads = 0;
+    long long chunk_cache_bytes = -1;
+    bool force = false;
+    std::string profile_mode;   // 空 = 不做统计，"on" 或 "only"
+};
+
+// 目标数据集是否经外部编码器 + H5Dwrite_chunk 写入（否则由 HDF5 过滤器在主线程中完成）
+// 有外部编码器时启用流水线：主线程读取下一个数据集的同时，工作线程压缩当前数据集；
+// encoder_only 的 spec 即使关闭流水线也必须经编码器写入（深度为 0 时逐个数据集编码完再继续）
+bool uses_encoder(const FilterSpec &spec, const SweepOptions &opt) {
+    return spec.encode && (opt.pipeline_depth > 0 || spec.encoder_only)
+           && spec.name != "baseline_none";
+}
+
+// 写入路径描述，既是结果缓存键的一部分，也写入 CSV 以区分多线程编码与 HDF5 主线程过滤器的计时
+std::string write_path(const FilterSpec &spec, const SweepOptions &opt) {
+    if (!uses_encoder(spec, opt)) return "hdf5";
+    return "encoder:threads=" + std::to_string(opt.n_threads) + ":depth=" + std::to_string(opt.pipeline_depth);
+}
+
+// 压缩前的信号统计：单遍读取全部目标数据集，估计零阶熵下界并给出预过滤建议
+void profile_source(H5::H5File &src, const fs::path &outdir) {
+    std::cout << "Profiling target signals ...\n";
+    BufferPool pbuffers;
+    NativeTypeCache ptypes;
+    SignalProfiler profiler;
+    std::vector<SignalProfile> profiles;
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::function<void(H5::Group, const std::string&)> walk;
+    walk = [&](H5::Group g, const std::string &gpath) {
+        hsize_t n = g.getNumObjs();
+        for (hsize_t i = 0; i < n; ++i) {
+            std::string name = g.getObjnameByIdx(i);
+            std::string path = (gpath == "/") ? "/" + name : gpath + "/" + name;
+            H5G_obj_t type = g.getObjTypeByIdx(i);
+            if (type == H5G_GROUP) {
+                walk(g.openGroup(name), path);
+            } else if (type == H5G_DATASET && is_target_dataset(path, name)) {
+                std::vector<char> buf;
+                hid_t memtid = -1;
+                std::vector<hsize_t> dims;
+                DataType cppdtype;
+                if (!read_dataset_raw(src, path, buf, memtid, dims, cppdtype, &pbuffers, &ptypes)) continue;
+                SignalProfile p;
+                p.path = path;
+                size_t nelem = buf.size() / std::max<size_t>(1, H5Tget_size(memtid));
+                if (profiler.profile(buf.data(), nelem, memtid, p)) profiles.push_back(p);
+                pbuffers.release(std::move(buf));
+            }
+        }
+    };
+    walk(src.openGroup("/"), "/");
+    flag_anomalies(profiles);
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    fs::path pcsv = outdir / "hdf5_signal_profile.csv";
+    std::ofstream pofs(pcsv);
+    pofs << "dataset,samples,min,max,bit_width,h0_bits,h0_delta_bits,mean_run,raw_bytes,bound_bytes,anomalous\n";
+    uint64_t raw_total = 0, bound_total = 0, samples_total = 0;
+    double h0_sum = 0.0, h0d_sum = 0.0;
+    unsigned width_max = 0;
+    size_t n_anom = 0;
+    for (auto &p : profiles) {
+        pofs << p.path << "," << p.samples << "," << p.min << "," << p.max << "," << p.bit_width << ","
+             << p.h0_bits << "," << p.h0_delta_bits << "," << p.mean_run << ","
+             << p.raw_bytes << "," << p.bound_bytes << "," << (p.anomalous ? 1 : 0) << "\n";
+        raw_total += p.raw_bytes;
+        bound_total += p.bound_bytes;
+        samples_total += p.samples;
+        h0_sum += p.h0_bits * p.samples;
+        h0d_sum += p.h0_delta_bits * p.samples;
+        width_max = std::max(width_max, p.bit_width);
+        n_anom += p.anomalous;
+    }
+    pofs.close();
+    double mib = 1024.0 * 1024.0;
+    double h0_avg = samples_total ? h0_sum / samples_total : 0.0;
+    double h0d_avg = samples_total ? h0d_sum / samples_total : 0.0;
+    std::cout << " -> " << profiles.size() << " datasets, " << samples_total << " samples in "
+              << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms\n";
+    std::cout << " -> raw " << raw_total / mib << " MB, order-0 bound " << bound_total / mib << " MB ("
+              << (raw_total ? double(bound_total) / raw_total : 0.0) << " of raw)\n";
+    std::cout << " -> mean h0=" << h0_avg << " bits, delta h0=" << h0d_avg << " bits, max bit width="
+              << width_max << ", anomalous=" << n_anom << "\n";
+    if (samples_total > 0 && h0d_avg + 0.5 < h0_avg) {
+        std::cout << " -> hint: first differences are cheaper than raw samples; try a delta pre-filter\n";
     }
+    if (!profiles.empty() && width_max < 8 * raw_total / samples_total) {
+        std::cout << " -> hint: values fit in " << width_max << " bits; scale-offset can pack them losslessly\n";
+    }
+    std::cout << "Profile written to: " << pcsv << "\n";
+}
 
+// 单个源文件的测试流程：运行本 rank 分到的 spec，结果以 (spec 序号, 结果) 追加到 local；返回非 0 表示需要终止
+int sweep_source(const std::string &src_path, const fs::path &outdir, size_t si,
+                 const std::vector<FilterSpec> &specs, const SweepOptions &opt, const MpiSession &mpi,
+                 EncodePool &pool, BufferPool &buffers, NativeTypeCache &types,
+                 std::vector<std::pair<size_t, Result>> &local) {
+    // (文件 × spec) 工作项轮转分配给各 rank
+    auto mine = [&](size_t k) {
+        return (si * specs.size() + k) % static_cast<size_t>(mpi.size()) == static_cast<size_t>(mpi.rank());
+    };
+    bool any_mine = false;
+    for (size_t k = 0; k < specs.size(); ++k) any_mine = any_mine || mine(k);
+    if (opt.profile_mode == "only" && mpi.rank() != 0) return 0;
+    if (!any_mine && !(mpi.rank() == 0 && !opt.profile_mode.empty())) return 0;
     // 打开源文件
-    H5::Exception::dontPrint();
     H5::H5File src;
     try {
         src = H5File(src_path, H5F_ACC_RDONLY);
@@ -265,9 +1504,17 @@ int main(int argc, char **argv) {
         return 2;
     }
 
+    // 压缩前的信号统计只在 rank 0 上做
+    if (!opt.profile_mode.empty() && mpi.rank() == 0) {
+        profile_source(src, outdir);
+        if (opt.profile_mode == "only") return 0;
+    }
+    if (!any_mine) return 0;
+
     // 创建输出目录
     fs::path baseline_file = outdir / "baseline_none.h5";
     auto run_one = [&](const FilterSpec &spec) -> Result {
+        auto run_t1 = std::chrono::high_resolution_clock::now();
         std::string fname = spec.name + ".h5";
         fs::path outpath = outdir / fname;
         // 创建输出文件，若存在则删除
@@ -280,8 +1527,133 @@ int main(int argc, char **argv) {
             return Result{spec.name,0,0,0};
         }
 
+        // 过滤器是否可用只需检查一次
+        bool filter_ok = !(spec.requires_avail && spec.check_id != 0) || H5Zfilter_avail(spec.check_id) > 0;
+        if (!filter_ok) {
+            std::cerr << "Filter " << spec.name << " not available; writing dataset uncompressed." << std::endl;
+        }
+        bool pipelined = filter_ok && uses_encoder(spec, opt);
+
+        double compress_ms = 0.0; //累计压缩时间（主线程）
+        double encode_cpu_ms = 0.0; //工作线程编码时间之和
+        std::deque<std::unique_ptr<PendingWrite>> inflight;
+
+        GroupCache groups(dst);
+        size_t allocs_before = buffers.allocations, reuses_before = buffers.reuses;
+        size_t type_miss_before = types.misses, exceptions_before = g_exceptions_caught;
+
+        // 等待最早提交的数据集编码完成，并在主线程写入全部 chunk
+        // 与串行路径的 H5Dwrite 一样，compress_ms 只计主线程耗时（等待 + 写入）
+        auto drain_one = [&]() {
+            auto t1 = std::chrono::high_resolution_clock::now();
+            std::unique_ptr<PendingWrite> pw = std::move(inflight.front());
+            inflight.pop_front();
+            bool okw = true;
+            for (size_t c = 0; c < pw->done.size(); ++c) {
+                double enc_ms = pw->done[c].get();
+                if (enc_ms < 0) { okw = false; continue; }
+                encode_cpu_ms += enc_ms;
+                const auto &chunk_data = pw->encoded[c];
+                herr_t err = H5Dwrite_chunk(pw->ds.getId(), H5P_DEFAULT, 0, pw->offsets[c].data(),
+                                            chunk_data.size(), chunk_data.data());
+                if (err < 0) okw = false;
+            }
+            auto t2 = std::chrono::high_resolution_clock::now();
+            compress_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+            if (!okw) std::cerr << "Warning: failed to write compressed dataset " << pw->path << "\n";
+            buffers.release(std::move(pw->buf));
+        };
+
+        // 把 pw 中各 chunk 的编码任务交给工作线程；pw->offsets 为空时按 dims/chunk 枚举全部 chunk
+        auto submit_chunks = [&](std::unique_ptr<PendingWrite> pw, const std::vector<hsize_t> &dims,
+                                 const std::vector<hsize_t> &chunk, size_t tsize) {
+            auto t1 = std::chrono::high_resolution_clock::now();
+            hsize_t chunk_elems = 1;
+            for (auto c : chunk) chunk_elems *= c;
+            size_t chunk_bytes = static_cast<size_t>(chunk_elems) * tsize;
+            // 枚举所有 chunk 的起始坐标
+            size_t rank = dims.size();
+            std::vector<hsize_t> off(rank, 0);
+            bool any = pw->offsets.empty();
+            for (auto d : dims) if (d == 0) any = false;
+            while (any) {
+                pw->offsets.push_back(off);
+                size_t d = rank;
+                while (d > 0) {
+                    --d;
+                    off[d] += chunk[d];
+                    if (off[d] < dims[d]) break;
+                    off[d] = 0;
+                    if (d == 0) any = false;
+                }
+                if (rank == 0) any = false;
+            }
+            pw->encoded.resize(pw->offsets.size());
+            const std::vector<hsize_t> dims_copy = dims;
+            const std::vector<hsize_t> chunk_copy = chunk;
+            // 单个 chunk 恰好覆盖整个缓冲区时直接编码，省去一次拷贝
+            bool whole = pw->offsets.size() == 1 && chunk == dims;
+            for (size_t c = 0; c < pw->offsets.size(); ++c) {
+                PendingWrite *raw = pw.get();
+                pw->done.push_back(pool.submit([raw, c, dims_copy, chunk_copy, tsize, chunk_bytes, whole, &spec]{
+                    if (whole) return spec.encode(raw->buf.data(), chunk_bytes, tsize, raw->encoded[c]);
+                    std::vector<char> tmp(chunk_bytes);
+                    gather_chunk(raw->buf.data(), dims_copy, chunk_copy, raw->offsets[c], tsize, tmp.data());
+                    return spec.encode(tmp.data(), chunk_bytes, tsize, raw->encoded[c]);
+                }));
+            }
+            inflight.push_back(std::move(pw));
+            auto t2 = std::chrono::high_resolution_clock::now();
+            compress_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+            while (inflight.size() > opt.pipeline_depth) drain_one();
+        };
+
+        // 目标数据集：主线程创建数据集并拆分 chunk，编码任务交给工作线程
+        auto submit_encoded = [&](const std::string &path, hid_t memtid, const std::vector<hsize_t> &dims,
+                                  std::vector<char> &&buf, const DSetCreatPropList &plist,
+                                  const std::vector<hsize_t> &chunk) -> bool {
+            auto pw = std::make_unique<PendingWrite>();
+            pw->path = path;
+            pw->buf = std::move(buf);
+            try {
+                auto t1 = std::chrono::high_resolution_clock::now();
+                pw->ds = create_dataset(dst, path, memtid, dims, plist, &groups);
+                auto t2 = std::chrono::high_resolution_clock::now();
+                compress_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+            } catch (...) {
+                ++g_exceptions_caught;
+                buffers.release(std::move(pw->buf));
+                return false;
+            }
+            submit_chunks(std::move(pw), dims, chunk, H5Tget_size(memtid));
+            return true;
+        };
+
+        // 为目标数据集配置 chunk 和过滤器
+        auto make_target_plist = [&](const std::vector<hsize_t> &chunk, const std::string &path) {
+            return build_target_plist(spec, filter_ok, chunk, path);
+        };
+
+        // 合并布局：目标 Signal 交给 ConsolidatedWriter；流水线路径下整 chunk 经工作线程编码
+        std::unique_ptr<ConsolidatedWriter> cons;
+        if (opt.layout == "consolidated" && spec.name != "baseline_none") {
+            ConsolidatedWriter::ChunkSubmit submit;
+            if (pipelined) {
+                submit = [&](const DataSet &ds, hsize_t off, size_t tsize, std::vector<char> &&chunk_buf) {
+                    auto pw = std::make_unique<PendingWrite>();
+                    pw->path = CONSOLIDATED_SIGNAL;
+                    pw->ds = ds;
+                    pw->buf = std::move(chunk_buf);
+                    pw->offsets.push_back({off});
+                    submit_chunks(std::move(pw), {opt.signal_chunk}, {opt.signal_chunk}, tsize);
+                };
+            }
+            cons = std::make_unique<ConsolidatedWriter>(dst, groups, buffers, opt.signal_chunk,
+                                                        make_target_plist({opt.signal_chunk}, CONSOLIDATED_SIGNAL),
+                                                        std::move(submit));
+        }
+
         // 递归遍历源文件对象，复制数据集和组
-        double compress_ms = 0.0; //累计压缩时间
         std::function<void(H5::Group, H5::Group, const std::string&)> recurse;
         recurse = [&](H5::Group gsrc, H5::Group gdst, const std::string &gpath) {
             hsize_t n = gsrc.getNumObjs();
@@ -294,13 +1666,12 @@ int main(int argc, char **argv) {
 
                 if (type == H5G_GROUP) {
                     // 创建目的组
-                    try { gdst.createGroup(name); } catch(...) {}
+                    Group ngdst = groups.get(child_src_path);
                     // 复制属性
                     hid_t src_loc = gsrc.getId();
                     hid_t dst_loc = gdst.getId();
                     copy_attributes(src_loc, name.c_str(), dst_loc);
                     Group ngsrc = gsrc.openGroup(name);
-                    Group ngdst = gdst.openGroup(name);
                     recurse(ngsrc, ngdst, child_src_path);
                 } else if (type == H5G_DATASET) {
                     // 检查是否为目标数据集
@@ -310,70 +1681,58 @@ int main(int argc, char **argv) {
                     hid_t memtid = -1;
                     std::vector<hsize_t> dims;
                     DataType cppdtype;
-                    bool ok = read_dataset_raw(src, child_src_path, buf, memtid, dims, cppdtype);
+                    bool ok = read_dataset_raw(src, child_src_path, buf, memtid, dims, cppdtype, &buffers, &types);
                     if (!ok) {
                         std::cerr << "Warning: failed read dataset " << child_src_path << "\n";
+                        buffers.release(std::move(buf));
                         continue;
                     }
 
+                    if (is_target && cons && name == "Signal" && dims.size() == 1 && dims[0] > 0) {
+                        if (cons->append(child_src_path, memtid, buf, dims[0])) {
+                            buffers.release(std::move(buf));
+                            continue;
+                        }
+                    }
+
                     // 创建属性列表
                     DSetCreatPropList plist;
+                    std::vector<hsize_t> chunk;
                     if (spec.name != "baseline_none") {
                         if (is_target) {
                             // chunk 设置
-                            std::vector<hsize_t> chunk = dims;
-                            if (chunk.size() == 0) chunk = {1};
-                            const hsize_t MAX_ELEMS = 1024*1024;
-                            hsize_t prod = 1;
-                            for (auto d : chunk) prod *= (d>0?d:1);
-                            while (prod > MAX_ELEMS) {
-                                for (auto &c : chunk) {
-                                    if (c > 1) { c = (c+1)/2; }
-                                }
-                                prod = 1;
-                                for (auto d : chunk) prod *= (d>0?d:1);
-                            }
-                            plist.setChunk((unsigned)chunk.size(), chunk.data());
-                            // 应用过滤器
-                            if (spec.requires_avail && spec.check_id != 0) {
-                                if (!H5Zfilter_avail(spec.check_id)) {
-                                    std::cerr << "Filter " << spec.name << " not available; writing dataset uncompressed." << std::endl;
-                                } else {
-                                    // // 设置 SZIP 选项
-                                    if (spec.check_id == H5Z_FILTER_SZIP) {           
-                                        herr_t r = H5Pset_szip(plist.getId(), H5_SZIP_NN_OPTION_MASK, 16);
-                                        if (r < 0) {
-                                            std::cerr << "Warning: failed to set SZIP options for " << child_src_path << "\n";
-                                        }
-                                    } else {
-                                        spec.apply((DSetCreatPropList&)plist);
-                                    }
-                                }
-                            } else {
-                                spec.apply((DSetCreatPropList&)plist);
-                            }
+                            chunk = compute_chunk_dims(dims);
+                            plist = make_target_plist(chunk, child_src_path);
                         }
                     }
 
+                    if (is_target && pipelined && !dims.empty()) {
+                        // 交给流水线，缓冲区所有权随之转移
+                        if (!submit_encoded(child_src_path, memtid, dims, std::move(buf), plist, chunk)) {
+                            std::cerr << "Warning: failed to write compressed dataset " << child_src_path << "\n";
+                        }
+                        continue;
+                    }
+
                     // 计算写入时间
                     double write_ms = 0.0;
                     if (is_target && spec.name != "baseline_none") {
                         auto t1 = std::chrono::high_resolution_clock::now();
-                        bool okw = create_and_write_dataset(dst, child_src_path, memtid, dims, buf, plist);
+                        bool okw = create_and_write_dataset(dst, child_src_path, memtid, dims, buf, plist, &groups);
                         auto t2 = std::chrono::high_resolution_clock::now();
                         write_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
                         if (!okw) std::cerr << "Warning: failed to write compressed dataset " << child_src_path << "\n";
                     } else {
                         // 写入非目标数据集或基线（无压缩）
                         auto t1 = std::chrono::high_resolution_clock::now();
-                        bool okw = create_and_write_dataset(dst, child_src_path, memtid, dims, buf, plist);
+                        bool okw = create_and_write_dataset(dst, child_src_path, memtid, dims, buf, plist, &groups);
                         auto t2 = std::chrono::high_resolution_clock::now();
                         write_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
                         if (!okw) std::cerr << "Warning: failed to write dataset " << child_src_path << "\n";                        
                     }
                     compress_ms += write_ms;
 
-                    if (memtid > 0) H5Tclose(memtid);
+                    buffers.release(std::move(buf));
                 }
             }
         };
@@ -381,8 +1740,34 @@ int main(int argc, char **argv) {
         Group root_src = src.openGroup("/");
         Group root_dst = dst.openGroup("/");
         recurse(root_src, root_dst, "/");
+        if (cons) {
+            cons->finish();
+            compress_ms += cons->write_ms;
+        }
+        while (!inflight.empty()) drain_one();
+
+        std::cout << " -> buffers: " << (buffers.allocations - allocs_before) << " allocated, "
+                  << (buffers.reuses - reuses_before) << " reused; native types resolved: "
+                  << (types.misses - type_miss_before) << "; groups opened: " << groups.misses
+                  << " (cache hits " << groups.hits << "); exceptions: "
+                  << (g_exceptions_caught - exceptions_before) << "\n";
 
         dst.flush(H5F_SCOPE_GLOBAL);
+        MemoryStats mem;
+        size_t mdc_max = 0, mdc_min_clean = 0, mdc_cur = 0;
+        int mdc_entries = 0;
+        if (H5Fget_mdc_size(dst.getId(), &mdc_max, &mdc_min_clean, &mdc_cur, &mdc_entries) >= 0) {
+            mem.mdc_bytes = mdc_cur;
+        }
+        {
+            FileAccPropList fapl = dst.getAccessPlist();
+            int mdc_nelmts = 0;
+            size_t rdcc_nslots = 0, rdcc_nbytes = 0;
+            double rdcc_w0 = 0.0;
+            if (H5Pget_cache(fapl.getId(), &mdc_nelmts, &rdcc_nslots, &rdcc_nbytes, &rdcc_w0) >= 0) {
+                mem.chunk_cache_bytes = rdcc_nbytes;
+            }
+        }
         dst.close();
 
         // 计算输出文件大小
@@ -390,26 +1775,155 @@ int main(int argc, char **argv) {
         try {
             fsize = fs::file_size(outpath);
         } catch(...) { fsize = 0; }
-       
+
         // 转换为 MB（MiB）
         double fsize_mb = static_cast<double>(fsize) / (1024.0 * 1024.0);
-        return Result{spec.name, fsize_mb, 0.0, compress_ms};
+        auto run_t2 = std::chrono::high_resolution_clock::now();
+        double wall_ms = std::chrono::duration<double, std::milli>(run_t2 - run_t1).count();
+        Result res{spec.name, fsize_mb, 0.0, compress_ms, wall_ms};
+        res.encode_cpu_ms = encode_cpu_ms;
+        res.mem = mem;
+        return res;
     };
 
-    // 首先生成基线文件
-    std::cout << "Generating baseline (no compression) ...\n";
-    FilterSpec baseline_spec = specs[0];
-    Result baseline_res = run_one(baseline_spec);
-    if (baseline_res.file_mb == 0) {
-        std::cerr << "Baseline generation failed or file size 0. Aborting.\n";
-        return 4;
+    // 随机读取基准使用的数据集访问属性列表
+    DSetAccPropList bench_dapl;
+    if (opt.chunk_cache_bytes >= 0) {
+        H5Pset_chunk_cache(bench_dapl.getId(), H5D_CHUNK_CACHE_NSLOTS_DEFAULT,
+                           static_cast<size_t>(opt.chunk_cache_bytes), H5D_CHUNK_CACHE_W0_DEFAULT);
     }
-    std::cout << "Baseline file size: " << baseline_res.file_mb << " bytes\n";
+    auto run_bench = [&](Result &r) {
+        // 集合写模式下所有 rank 共享同一个输出文件，只在 rank 0 上测读取
+        if (opt.bench_reads == 0) return;
+        fs::path file = outdir / (r.filter_name + ".h5");
+        try {
+            bench_random_access(file, opt.bench_reads, opt.chunk_cache_bytes >= 0 ? bench_dapl.getId() : H5P_DEFAULT,
+                                12345, r);
+        } catch (...) {
+            std::cerr << "Warning: random read benchmark failed for " << file << "\n";
+        }
+    };
+    auto print_bench = [&](const Result &r) {
+        if (opt.bench_reads == 0) return;
+        std::cout << " -> random reads: cold p50=" << r.cold.p50_ms << " ms, p99=" << r.cold.p99_ms
+                  << " ms, " << r.cold.reads_per_s << " reads/s; warm p50=" << r.warm.p50_ms
+                  << " ms, p99=" << r.warm.p99_ms << " ms, " << r.warm.reads_per_s << " reads/s\n";
+    };
+
+    // 结果缓存的键：spec 实际生成的过滤器管线（id、flags、cd_values）+ chunk 规则 + 布局 + 写入路径。
+    // 写入路径决定 compress_ms 的来源，经编码器写入时线程数和流水线深度也会影响计时
+    auto spec_key = [&](const FilterSpec &spec) -> std::string {
+        std::ostringstream key;
+        key << spec.name;
+        if (spec.name == "baseline_none") return key.str() + "|contiguous";
+        DSetCreatPropList p;
+        hsize_t probe_chunk = 1024;
+        p.setChunk(1, &probe_chunk);
+        if (spec.check_id == H5Z_FILTER_SZIP) H5Pset_szip(p.getId(), H5_SZIP_NN_OPTION_MASK, 16);
+        else spec.apply(p);
+        int nfilters = H5Pget_nfilters(p.getId());
+        for (int f = 0; f < nfilters; ++f) {
+            unsigned int flags = 0, cd[16];
+            size_t ncd = 16;
+            H5Z_filter_t id = H5Pget_filter2(p.getId(), static_cast<unsigned>(f), &flags, &ncd, cd, 0, nullptr, nullptr);
+            key << "|filter=" << id << ":" << flags << ":";
+            for (size_t c = 0; c < ncd && c < 16; ++c) key << (c ? "," : "") << cd[c];
+        }
+        key << "|chunk=halve<=" << CHUNK_MAX_ELEMS;
+        if (opt.layout == "consolidated") key << "|layout=consolidated:" << opt.signal_chunk;
+        key << "|write=" << write_path(spec, opt);
+        return key.str();
+    };
+    // cold=open：冷读延迟包含打开数据集 / 构造 ConsolidatedReader 的开销，与此前不含该开销的缓存结果区分
+    std::string bench_key = opt.bench_reads == 0 ? "off"
+        : "reads=" + std::to_string(opt.bench_reads) + ";chunk_cache=" + std::to_string(opt.chunk_cache_bytes) + ";cold=open";
 
-    std::vector<Result> results;
-    results.push_back(baseline_res);
+    std::string source_id;
+    try {
+        source_id = source_identity(src_path);
+    } catch (...) {
+        std::cerr << "Failed to identify source file: " << src_path << "\n";
+        return 2;
+    }
+    std::string cache_name = mpi.size() > 1 ? "hdf5_results_cache.rank" + std::to_string(mpi.rank()) + ".tsv"
+                                            : "hdf5_results_cache.tsv";
+    ResultsCache cache(outdir, cache_name, source_id);
+
+    // 运行一个 spec；缓存命中时直接复用，只有基准配置变化且输出文件仍在时才重跑基准
+    auto measure = [&](const FilterSpec &spec) -> Result {
+        std::string key = spec_key(spec);
+        fs::path file = outdir / (spec.name + ".h5");
+        const ResultsCache::Entry *hit = opt.force ? nullptr : cache.find(key);
+        if (hit && hit->result.file_mb > 0 && (hit->bench_key == bench_key || fs::exists(file))) {
+            Result r = hit->result;
+            if (hit->bench_key != bench_key) {
+                std::cout << " -> cached result reused; rerunning read benchmark\n";
+                r.cold = LatencyStats();
+                r.warm = LatencyStats();
+                run_bench(r);
+                cache.store(key, bench_key, r);
+            } else {
+                std::cout << " -> cached result reused\n";
+            }
+            return r;
+        }
+        // 运行前后采样内存：峰值 RSS 先清零，operator new 峰值从当前存活量开始计，
+        // HDF5 free list 先回收再记下剩余量（源文件仍打开时回收不完），运行后报告增量
+        H5garbage_collect();
+        size_t fl_reg = 0, fl_arr = 0, fl_blk = 0, fl_fac = 0;
+        uint64_t fl_before = H5get_free_list_sizes(&fl_reg, &fl_arr, &fl_blk, &fl_fac) >= 0
+                           ? fl_reg + fl_arr + fl_blk + fl_fac : 0;
+        bool hwm_reset = reset_peak_rss();
+        uint64_t rss_before_kb = read_proc_status_kb("VmRSS");
+        uint64_t alloc_before = g_alloc_bytes.load();
+        g_alloc_peak.store(g_alloc_live.load());
+        Result r = run_one(spec);
+        uint64_t hwm_kb = read_proc_status_kb("VmHWM");
+        r.mem.rss_peak_delta_mb = hwm_kb > rss_before_kb ? (hwm_kb - rss_before_kb) / 1024.0 : 0.0;
+        r.mem.rss_peak_mb = hwm_kb / 1024.0;
+        r.mem.tool_alloc_bytes = g_alloc_bytes.load() - alloc_before;
+        r.mem.tool_peak_live_bytes = g_alloc_peak.load();
+        if (H5get_free_list_sizes(&fl_reg, &fl_arr, &fl_blk, &fl_fac) >= 0) {
+            uint64_t fl_after = fl_reg + fl_arr + fl_blk + fl_fac;
+            r.mem.h5_free_list_bytes = fl_after > fl_before ? fl_after - fl_before : 0;
+        }
+        std::cout << " -> memory: peak RSS " << r.mem.rss_peak_mb << " MB (+" << r.mem.rss_peak_delta_mb << " MB)"
+                  << (hwm_reset ? "" : " (peak not resettable; process-wide high-water mark)")
+                  << ", tool allocated ";
+        if (g_alloc_tracking) {
+            std::cout << r.mem.tool_alloc_bytes / (1024.0 * 1024.0) << " MB (peak live "
+                      << r.mem.tool_peak_live_bytes / (1024.0 * 1024.0) << " MB)";
+        } else {
+            std::cout << "n/a (build with -DENABLE_ALLOC_STATS=ON)";
+        }
+        std::cout << ", HDF5 free lists "
+                  << r.mem.h5_free_list_bytes / 1024.0 << " KB, metadata cache "
+                  << r.mem.mdc_bytes / 1024.0 << " KB, chunk cache limit "
+                  << r.mem.chunk_cache_bytes / 1024.0 << " KB\n";
+        if (r.file_mb > 0) {
+            run_bench(r);
+            cache.store(key, bench_key, r);
+        }
+        return r;
+    };
+
+    // 首先生成基线文件；多 rank 时基线可能不在本 rank，比率由 rank 0 汇总后计算
+    Result baseline_res{"baseline_none", 0, 0.0, 0.0};
+    if (mine(0)) {
+        std::cout << "Generating baseline (no compression) ...\n";
+        FilterSpec baseline_spec = specs[0];
+        baseline_res = measure(baseline_spec);
+        if (baseline_res.file_mb == 0) {
+            std::cerr << "Baseline generation failed or file size 0. Aborting.\n";
+            return 4;
+        }
+        std::cout << "Baseline file size: " << baseline_res.file_mb << " bytes\n";
+        print_bench(baseline_res);
+        local.emplace_back(0, baseline_res);
+    }
 
     for (size_t i = 1; i < specs.size(); ++i) {
+        if (!mine(i)) continue;
         const auto &spec = specs[i];
         if (spec.requires_avail && spec.check_id != 0) {
             if (!H5Zfilter_avail(spec.check_id)) {
@@ -418,7 +1932,7 @@ int main(int argc, char **argv) {
             }
         }
         std::cout << "Running filter: " << spec.name << " ...\n";
-        Result r = run_one(spec);
+        Result r = measure(spec);
         if (r.file_mb == 0) {
             std::cerr << "Warning: result file size 0 for " << spec.name << "\n";
         }
@@ -428,21 +1942,223 @@ int main(int argc, char **argv) {
         } else {
             r.ratio = 0.0;
         }
-        results.push_back(r);
-        std::cout << " -> size=" << r.file_mb << " MB, ratio=" << r.ratio << ", compress_ms=" << r.compress_ms << "\n";
+        std::cout << " -> size=" << r.file_mb << " MB, ratio=" << r.ratio << ", compress_ms=" << r.compress_ms
+                  << ", wall_ms=" << r.wall_ms << ", encode_cpu_ms=" << r.encode_cpu_ms << "\n";
+        print_bench(r);
+        local.emplace_back(i, r);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    MpiSession mpi(argc, argv);
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0] << " <source.h5|source-dir> <out-dir> [options]\n";
+        std::cout << "A directory source sweeps every .h5/.hdf5/.fast5 file in it into <out-dir>/<file stem>/.\n";
+        std::cout << "Options:\n";
+        std::cout << "  --threads=N         compression worker threads (default: hardware concurrency,\n";
+        std::cout << "                      divided among the MPI ranks on the same node)\n";
+        std::cout << "  --pipeline-depth=N  datasets in flight between read and write stages (default: 0 = serial)\n";
+        std::cout << "  --layout=L          per-read (default) or consolidated: pack all read_*/Raw/Signal into one dataset\n";
+        std::cout << "  --signal-chunk=N    chunk size in samples of the consolidated signal dataset (default: 1048576)\n";
+        std::cout << "  --bench-reads=K     after each spec, time K random read fetches cold and warm (default: 0 = off)\n";
+        std::cout << "  --chunk-cache=B     chunk cache size in bytes for the read benchmark (default: HDF5 default)\n";
+        std::cout << "  --force             ignore the results cache in <out-dir> and rerun every spec\n";
+        std::cout << "  --profile[=only]    profile target signals (range, entropy, runs, bit width) before the sweep;\n";
+        std::cout << "                      'only' exits after profiling\n";
+#ifdef USE_MPI
+        std::cout << "MPI build: (file x spec) work items are spread round-robin over ranks; results are\n";
+        std::cout << "collected on rank 0.\n";
+#endif
+        std::cout << "Example: " << argv[0] << " data.h5 out --threads=8\n";
+        return 1;
     }
+    fs::path src_arg = argv[1];
+    fs::path out_root = argv[2];
+    fs::create_directories(out_root);
 
-    // 输出 CSV
-    fs::path csv = outdir / "hdf5_filter_results.csv";
-    std::ofstream ofs(csv);
-    ofs << "filter,file_mb,ratio_compressed_over_baseline,compress_ms\n";
-    for (auto &res : results) {
-        ofs << res.filter_name << "," << res.file_mb << "," << res.ratio << "," << res.compress_ms << "\n";
+    // 可选参数，形如 --name=value
+    // 流水线默认关闭，所有 spec 的 compress_ms 都在主线程写入路径上测得，与单线程插件可比
+    SweepOptions opt;
+    // 同一节点上的多个 rank 平分 CPU 核，避免编码线程数成倍超订
+    opt.n_threads = std::max(1u, opt.n_threads / static_cast<unsigned int>(mpi.local_size()));
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string val = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+        try {
+            if (key == "--threads") opt.n_threads = std::max(1, std::stoi(val));
+            else if (key == "--pipeline-depth") opt.pipeline_depth = static_cast<size_t>(std::max(0, std::stoi(val)));
+            else if (key == "--layout") {
+                if (val != "per-read" && val != "consolidated") throw std::invalid_argument(val);
+                opt.layout = val;
+            }
+            else if (key == "--force" && eq == std::string::npos) opt.force = true;
+            else if (key == "--profile") {
+                if (eq != std::string::npos && val != "only") throw std::invalid_argument(val);
+                opt.profile_mode = val.empty() ? "on" : val;
+            }
+            else if (key == "--bench-reads") opt.bench_reads = static_cast<size_t>(std::max(0, std::stoi(val)));
+            else if (key == "--chunk-cache") opt.chunk_cache_bytes = std::max(0LL, std::stoll(val));
+            else if (key == "--signal-chunk") opt.signal_chunk = static_cast<hsize_t>(std::max(1LL, std::stoll(val)));
+            else {
+                std::cerr << "Unknown option: " << arg << "\n";
+                return 1;
+            }
+        } catch (...) {
+            std::cerr << "Invalid value for option: " << arg << "\n";
+            return 1;
+        }
     }
-    ofs.close();
 
-    std::cout << "Done. Results at: " << csv << "\n";
-    return 0;
+    // 插件过滤器需要在运行前注册
+    std::vector<FilterSpec> specs;
+
+    // 基线文件
+    specs.push_back({"baseline_none", [](DSetCreatPropList &p){ /* no change */ }, false, 0});
+
+    // shuffle + gzip levels 1,6,9
+    unsigned int gzip_cp_levs[3] = {1,6,9};
+    for (unsigned int lev : gzip_cp_levs) {
+        std::string fname = "shuffle_gzip_lvl" + std::to_string(lev);
+        specs.push_back({fname, [lev](DSetCreatPropList &p){ p.setShuffle(); p.setDeflate(lev); }, false, H5Z_FILTER_DEFLATE,
+                         make_shuffle_deflate_encoder(static_cast<int>(lev))});
+    }
+    // shuffle + libdeflate：同样写成标准 deflate 过滤器，与上面的 zlib 同级别对照，另加 libdeflate 最高级别 12
+    unsigned int libdeflate_levs[4] = {1,6,9,12};
+    if (!LibDeflate::instance().ok()) {
+        std::cerr << "libdeflate not found; skipping shuffle_libdeflate specs.\n";
+    } else {
+        for (unsigned int lev : libdeflate_levs) {
+            // HDF5 的 deflate 级别上限为 9，cd_values 只记录级别，不影响解码
+            unsigned int h5_lev = std::min(lev, 9u);
+            specs.push_back({"shuffle_libdeflate_lvl" + std::to_string(lev),
+                             [h5_lev](DSetCreatPropList &p){ p.setShuffle(); p.setDeflate(h5_lev); }, false, H5Z_FILTER_DEFLATE,
+                             make_shuffle_libdeflate_encoder(static_cast<int>(lev)), true});
+        }
+        // 对照的 zlib spec 也固定走编码器 + H5Dwrite_chunk，两者的计时路径相同（输出仍与 HDF5 deflate 逐字节一致）
+        for (auto &spec : specs) {
+            if (spec.name.rfind("shuffle_gzip_lvl", 0) == 0) spec.encoder_only = true;
+        }
+    }
+    // szip
+#ifdef H5Z_FILTER_SZIP
+    specs.push_back({"szip", [](DSetCreatPropList &p){
+    }, true, H5Z_FILTER_SZIP});
+#else
+    specs.push_back({"szip", [](DSetCreatPropList &p){}, true, H5Z_FILTER_SZIP});
+#endif
+
+    // vbz levels 1,11,22
+    /*unsigned int vbz_cp_levs[3] = {1,11,22};
+    for (unsigned int lev : vbz_cp_levs) {
+        std::string fname = "shuffle_vbz_lvl" + std::to_string(lev);
+        unsigned int cd_vals[4] = {0, lev, 1, 1};
+        specs.push_back(
+            {fname,
+            [cd_vals](DSetCreatPropList &p){
+                p.setFilter(FILTER_VBZ_ID, H5Z_FLAG_MANDATORY , 4, cd_vals);
+            },
+            true,      
+            FILTER_VBZ_ID
+        });
+    }*/
+
+    // lz4 (no level setting)
+    specs.push_back({"lz4", [](DSetCreatPropList &p){
+        p.setFilter(H5Z_FILTER_LZ4 , H5Z_FLAG_MANDATORY, 0, nullptr);
+    }, true, H5Z_FILTER_LZ4 });
+
+    // zstd 
+    unsigned int levels[3] = {1, 11, 22};
+    for (unsigned int lev : levels) {
+        std::string fname = "zstd_lvl" + std::to_string(lev);
+        specs.push_back({fname, [lev](DSetCreatPropList &p){
+            p.setFilter(H5Z_FILTER_ZSTD, H5Z_FLAG_MANDATORY , 1,&lev);
+        }, true, H5Z_FILTER_ZSTD });
+    }
+
+    // 源可以是单个文件，也可以是目录：目录中的每个文件各自输出到 <out-dir>/<文件名>/
+    std::vector<fs::path> sources;
+    bool per_source_dirs = fs::is_directory(src_arg);
+    if (per_source_dirs) {
+        for (const auto &de : fs::directory_iterator(src_arg)) {
+            std::string ext = de.path().extension().string();
+            if (de.is_regular_file() && (ext == ".h5" || ext == ".hdf5" || ext == ".fast5")) sources.push_back(de.path());
+        }
+        std::sort(sources.begin(), sources.end());
+    } else {
+        sources.push_back(src_arg);
+    }
+
+    H5::Exception::dontPrint();
+    EncodePool pool(opt.n_threads);
+    BufferPool buffers;      // 跨数据集、跨 spec、跨文件复用的读缓冲区
+    NativeTypeCache types;   // 跨 spec 复用的本机类型
+    int exit_code = 0;
+
+    for (size_t si = 0; si < sources.size(); ++si) {
+        std::string src_path = sources[si].string();
+        fs::path outdir = per_source_dirs ? out_root / sources[si].stem() : out_root;
+        fs::create_directories(outdir);
+
+        std::vector<std::pair<size_t, Result>> local;   // 本 rank 完成的 (spec 序号, 结果)
+
+        int status = sweep_source(src_path, outdir, si, specs, opt, mpi, pool, buffers, types, local);
+        if (status != 0 && mpi.size() == 1) return status;
+        if (status != 0) exit_code = status;
+        if (opt.profile_mode == "only") continue;
+
+        // 汇总到 rank 0：每行为 spec 序号加 result_to_tsv 的字段
+        std::ostringstream payload;
+        for (const auto &item : local) payload << item.first << "\t" << result_to_tsv(item.second) << "\n";
+        std::string gathered = mpi.gather(payload.str());
+        if (mpi.rank() != 0) continue;
+        std::map<size_t, Result> merged;
+        std::istringstream lines(gathered);
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::vector<std::string> f = split_tsv(line);
+            Result r;
+            if (!f.empty() && result_from_tsv(f, 1, r)) merged[std::stoul(f[0])] = r;
+        }
+        auto base = merged.find(0);
+        if (base == merged.end() || base->second.file_mb == 0) {
+            std::cerr << "Baseline missing for " << src_path << "; no results written.\n";
+            exit_code = 4;
+            continue;
+        }
+        std::vector<Result> results;
+        std::vector<std::string> write_paths;
+        for (auto &item : merged) {
+            Result r = item.second;
+            // 计算压缩比率
+            r.ratio = (item.first != 0 && r.file_mb > 0) ? double(r.file_mb) / double(base->second.file_mb) : 0.0;
+            results.push_back(r);
+            write_paths.push_back(write_path(specs[item.first], opt));
+        }
+
+        // 输出 CSV
+        fs::path csv = outdir / "hdf5_filter_results.csv";
+        std::ofstream ofs(csv);
+        ofs << "filter,file_mb,ratio_compressed_over_baseline,compress_ms,wall_ms,encode_cpu_ms,write_path,"
+               "cold_p50_ms,cold_p99_ms,cold_reads_per_s,warm_p50_ms,warm_p99_ms,warm_reads_per_s,"
+               "rss_peak_delta_mb,rss_peak_mb,tool_alloc_bytes,tool_peak_live_bytes,h5_free_list_bytes,mdc_bytes,chunk_cache_bytes\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result &res = results[i];
+            ofs << res.filter_name << "," << res.file_mb << "," << res.ratio << "," << res.compress_ms << "," << res.wall_ms << "," << res.encode_cpu_ms << ","
+                << write_paths[i] << ","
+                << res.cold.p50_ms << "," << res.cold.p99_ms << "," << res.cold.reads_per_s << ","
+                << res.warm.p50_ms << "," << res.warm.p99_ms << "," << res.warm.reads_per_s << ","
+                << res.mem.rss_peak_delta_mb << "," << res.mem.rss_peak_mb << "," << res.mem.tool_alloc_bytes << "," << res.mem.tool_peak_live_bytes << ","
+                << res.mem.h5_free_list_bytes << "," << res.mem.mdc_bytes << "," << res.mem.chunk_cache_bytes << "\n";
+        }
+        ofs.close();
+
+        std::cout << "Done. Results at: " << csv << "\n";
+    }
+    return exit_code;
 }
 
 